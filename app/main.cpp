@@ -22,18 +22,162 @@ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR I
  * @copyright Copyright (c) 2023
  *
  */
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
 #include <iostream>
+#include <mutex>
+#include <sstream>
 #include <opencv2/imgcodecs.hpp>
+#include <thread>
 
+#include "batch.hpp"
+#include "checkpoint.hpp"
+#include "detection.hpp"
+#include "displaying.hpp"
+#include "threading.hpp"
 #include "tracking.hpp"
 
+/**
+ * @brief Parses a whole command line value as a finite number. Unlike atof, a
+ * value such as "abc" or "0.5s" is refused instead of read as 0 or 0.5.
+ *
+ * @param text The value
+ * @param value Receives the number, untouched on failure
+ * @return True if the value is a number and nothing else.
+ */
+static bool parseNumber(const std::string& text, double& value) {
+  char* end = nullptr;
+  double parsed = std::strtod(text.c_str(), &end);
+  if (text.empty() || *end != '\0' || !std::isfinite(parsed)) {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
 /**
  * @brief The main method of the file used to test and check whether the library
  * works as intended
  *
+ * @param argc Number of command line arguments
+ * @param argv Thread placement options, see ThreadPlacement::parseOption
  * @return int
  */
-int main() {
+int main(int argc, char** argv) {
+  /**
+   * @brief Parse the thread placement options given on the command line
+   *
+   */
+  ThreadPlacement placement;
+  PrefilterMode prefilter = PrefilterMode::kNone;
+  std::string cascadePath;
+  double previewScale = 1.0;
+  std::string input = "0";
+  cv::Size workingSize;
+  bool keepFullFrame = true;
+  double targetFps = 0;
+  std::string batchDirectory, batchOutput = "detections.htbd";
+  int batchSize = 8, decodeThreads = 0;
+  std::string checkpointPath;
+  double checkpointInterval = 0.2, checkpointMaxAge = 5;
+  for (int i = 1; i < argc; i++) {
+    std::string name = argv[i];
+    std::string value = i + 1 < argc ? argv[i + 1] : "";
+    bool valid = i + 1 < argc;
+    if (valid && name == "--prefilter") {
+      if (value == "lowres") {
+        prefilter = PrefilterMode::kLowResNet;
+      } else if (value.compare(0, 8, "cascade:") == 0) {
+        prefilter = PrefilterMode::kCascade;
+        cascadePath = value.substr(8);
+      } else {
+        valid = false;
+      }
+    } else if (valid && name == "--input") {
+      input = value;
+    } else if (valid && name == "--working-size") {
+      char separator = 0;
+      std::istringstream size(value);
+      valid = (size >> workingSize.width >> separator >> workingSize.height) &&
+              (size >> std::ws).eof() && separator == 'x' &&
+              !workingSize.empty();
+    } else if (valid && name == "--full-frame") {
+      keepFullFrame = value == "1";
+      valid = value == "0" || value == "1";
+    } else if (valid && name == "--target-fps") {
+      valid = parseNumber(value, targetFps) && targetFps >= 0;
+    } else if (valid && name == "--batch") {
+      batchDirectory = value;
+    } else if (valid && name == "--out") {
+      batchOutput = value;
+    } else if (valid && name == "--batch-size") {
+      valid = ThreadPlacement::parseCount(value, batchSize) && batchSize > 0;
+    } else if (valid && name == "--decode-threads") {
+      valid = ThreadPlacement::parseCount(value, decodeThreads);
+    } else if (valid && name == "--checkpoint") {
+      checkpointPath = value;
+    } else if (valid && name == "--checkpoint-interval") {
+      valid = parseNumber(value, checkpointInterval) && checkpointInterval >= 0;
+    } else if (valid && name == "--checkpoint-max-age") {
+      valid = parseNumber(value, checkpointMaxAge) && checkpointMaxAge >= 0;
+    } else if (valid && name == "--preview-scale") {
+      valid = parseNumber(value, previewScale) && previewScale > 0 &&
+              previewScale <= 1;
+    } else if (valid) {
+      valid = placement.parseOption(name, value);
+    }
+    if (!valid) {
+      std::cerr << "Invalid option " << name
+                << (i + 1 < argc ? " " + value : "") << std::endl;
+      std::cerr << "Usage: " << argv[0]
+                << " [--dnn-threads N] [--capture-priority P]"
+                << " [--{capture,inference,output}-cpus LIST|nodeN]"
+                << " [--prefilter lowres|cascade:FILE] [--preview-scale S]"
+                << " [--input CAMERA|FILE|URI] [--working-size WxH]"
+                << " [--full-frame 0|1] [--target-fps F]"
+                << " [--batch DIR [--out FILE] [--batch-size N]"
+                << " [--decode-threads N]] [--checkpoint FILE]"
+                << " [--checkpoint-interval S] [--checkpoint-max-age S]"
+                << std::endl
+                << "Files and URIs are scaled inside a GStreamer decoder only"
+                << " with --full-frame 0, the default 1 scales decoded frames."
+                << std::endl;
+      return 1;
+    }
+    i++;
+  }
+
+  /**
+   * @brief Batch mode detects faces in every image below a directory and
+   * writes them to a columnar file, without tracking or preview
+   *
+   */
+  if (!batchDirectory.empty()) {
+    DetectionClass detector(
+        "models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
+        "models/deploy.prototxt");
+    BatchProcessor batch(detector, decodeThreads, batchSize);
+    // Decoding is the capture stage of batch mode. Inference is pinned only
+    // after the pool has started, so the pool stays off the DNN cores
+    batch.onDecodeStart = [&placement]() {
+      placement.pinCurrentThread(ThreadRole::kCapture);
+    };
+    batch.onWriteStart = [&placement]() {
+      placement.pinCurrentThread(ThreadRole::kOutput);
+    };
+    batch.onInferenceStart = [&placement]() {
+      placement.pinCurrentThread(ThreadRole::kInference);
+      placement.applyDnnThreads();
+    };
+    bool ok = batch.run(batchDirectory, batchOutput);
+    std::cout << placement.topologyReport();
+    std::cout << batch.imagesDecoded << " images decoded, "
+              << batch.imagesFailed << " failed, " << batch.facesWritten
+              << " faces written to " << batchOutput << std::endl;
+    return ok ? 0 : 1;
+  }
+
   /**
    * @brief variables used to get the natural configuration of camera and car
    *
@@ -51,46 +195,142 @@ int main() {
   std::cin >> tv;
 
   /**
-   * @brief Initialise a tracker class to be used for tracking obstacles
+   * @brief Initialise the detector that owns the video stream and a tracker
+   * class to be used for tracking obstacles
+   *
+   */
+  DetectionClass detector(
+      "models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
+      "models/deploy.prototxt");
+  TrackingClass tracker(x, y, z, th, tv);
+
+  /**
+   * @brief Warm start from a recent checkpoint so that obstacles keep their
+   * IDs across a restart, then keep checkpointing in the background
+   *
+   */
+  TrackerState restored;
+  double checkpointAge = 0;
+  if (!checkpointPath.empty() &&
+      TrackerCheckpoint::load(checkpointPath, restored, checkpointMaxAge,
+                              &checkpointAge)) {
+    tracker.restore(restored);
+    std::cout << "Warm start with " << restored.tracks.size()
+              << " obstacles from a " << checkpointAge << " s old checkpoint"
+              << std::endl;
+  }
+  TrackerCheckpoint checkpoint(checkpointPath, checkpointInterval);
+
+  /**
+   * @brief Enable the optional first detection stage
    *
    */
-  TrackingClass tracker("models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
-                        "models/deploy.prototxt", x, y, z, th, tv);
+  if (!detector.enablePrefilter(prefilter, cascadePath)) {
+    std::cerr << "Cannot load cascade " << cascadePath << std::endl;
+    return 1;
+  }
 
   /**
    * @brief Initialise the video
    *
    */
-  if (!tracker.image.initVideoStream(0)) {
+  if (!detector.initVideoStream(input, workingSize, keepFullFrame,
+                                targetFps)) {
     return 0;
   }
 
+  /**
+   * @brief Pin the inference loop and start the OpenCV worker pool before any
+   * other thread runs OpenCV code, so that the pool has the DNN budget and
+   * the inference affinity rather than those of the capture thread. Threads
+   * started below pin themselves and do not keep the inference cores
+   *
+   */
+  placement.pinCurrentThread(ThreadRole::kInference);
+  placement.applyDnnThreads();
+
+  /**
+   * @brief Capture runs on its own pinned thread and only ever hands over the
+   * most recent frame, so a slow inference step drops frames instead of
+   * queueing them.
+   *
+   */
+  std::mutex frameMutex;
+  std::condition_variable frameReady;
+  VideoFrame latestFrame;
+  bool running = true;
+  std::thread captureThread([&]() {
+    placement.pinCurrentThread(ThreadRole::kCapture);
+    placement.applyCapturePriority();
+    VideoFrame grabbed;
+    while (true) {
+      bool read = detector.readFrame(grabbed);
+      std::lock_guard<std::mutex> lock(frameMutex);
+      if (!running || !read) {
+        running = false;
+        frameReady.notify_one();
+        return;
+      }
+      // readFrame() releases grabbed, so the handed-over frame stays intact
+      latestFrame = grabbed;
+      frameReady.notify_one();
+    }
+  });
+
+  /**
+   * @brief The preview is drawn on its own pinned thread and never holds up
+   * the loop below, which only shows the latest drawn preview
+   *
+   */
+  DisplayClass display("Image", previewScale, [&placement]() {
+    placement.pinCurrentThread(ThreadRole::kOutput);
+  });
+
   /**
    * @brief Initialise a frame
    *
    */
-  cv::Mat frame;
+  VideoFrame frame;
+  bool reported = false;
 
   while (true) {
-    tracker.image.videoCapture >> frame;
+    {
+      std::unique_lock<std::mutex> lock(frameMutex);
+      frameReady.wait(
+          lock, [&]() { return !running || !latestFrame.working.empty(); });
+      if (latestFrame.working.empty()) {
+        break;
+      }
+      frame = latestFrame;
+      latestFrame = VideoFrame();
+    }
+    if (!reported) {
+      std::cout << placement.topologyReport();
+      reported = true;
+    }
 
     /**
-     * @brief Get detections and store in variable rectangles
+     * @brief Get detections on the working frame and store them in variable
+     * rectangles in source resolution coordinates
      *
      */
-    auto rectangles = tracker.image.detectFaces(frame);
+    auto rectangles = DetectionClass::mapToFullResolution(
+        detector.detectFaces(frame.working), frame);
 
     /**
-     * @brief Assign IDs to the detections
+     * @brief Assign IDs to the detections, obstacleMapVector is updated in
+     * place and briefly lost obstacles are re-identified by appearance
      *
      */
-    tracker.obstacleMapVector = tracker.assignIDAndTrack(rectangles);
+    tracker.updateTracks(rectangles, frame.working, frame.fullSize);
+    checkpoint.publish(tracker);
 
     /**
      * @brief Find distance from camera frame
      *
      */
-    auto cameraDistance = tracker.distFromCamera(frame.cols, frame.rows);
+    auto cameraDistance =
+        tracker.distFromCamera(frame.fullSize.width, frame.fullSize.height);
 
     /**
      * @brief Find distance from car frame in inches
@@ -98,10 +338,9 @@ int main() {
      */
     auto carDistance = tracker.distFromCar(cameraDistance);
 
-    cv::Scalar color(0, 105, 205);
-
     /**
-     * @brief Draw rectangles for the detections and the distances
+     * @brief Report the distances, hand the overlay to the render thread and
+     * show the latest preview, HighGUI stays on this thread
      *
      */
     for (const auto& r : tracker.obstacleMapVector) {
@@ -110,32 +349,18 @@ int main() {
                 << static_cast<int>(std::get<1>(carDistance[r.first])) << ", "
                 << static_cast<int>(std::get<2>(carDistance[r.first])) << ")"
                 << std::endl;
-      cv::rectangle(frame, r.second, color, 4);
-      cv::putText(frame,
-                  std::to_string(r.first) + ": (" +
-                      std::to_string(
-                          static_cast<int>(std::get<0>(carDistance[r.first]))) +
-                      ", " +
-                      std::to_string(
-                          static_cast<int>(std::get<1>(carDistance[r.first]))) +
-                      ", " +
-                      std::to_string(
-                          static_cast<int>(std::get<2>(carDistance[r.first]))) +
-                      ")",
-                  cv::Point(r.second.x, r.second.y - 5),
-                  cv::FONT_HERSHEY_COMPLEX, 1.0, CV_RGB(255, 0, 0), 2);
     }
-
-    /**
-     * @brief Display the frame
-     *
-     */
-    imshow("Image", frame);
-    int esc_key = 27;
-    if (cv::waitKey(10) == esc_key) {
+    display.submit(frame.full.empty() ? frame.working : frame.full,
+                   tracker.obstacleMapVector, carDistance, frame.fullSize);
+    display.show();
+    if (display.stopRequested()) {
       break;
     }
   }
 
-  cv::destroyAllWindows();
+  {
+    std::lock_guard<std::mutex> lock(frameMutex);
+    running = false;
+  }
+  captureThread.join();
 }
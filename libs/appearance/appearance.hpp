@@ -0,0 +1,129 @@
+/**
+Copyright © 2023 <copyright holders>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/**
+ * @file appearance.hpp
+ * @author Lowell Lobo
+ * @author Mayank Deshpande
+ * @author Kautilya Chappidi
+ * @brief Class Definition for the AppearanceGallery
+ * @version 0.1
+ * @date 2023-11-13
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef APPEARANCE_HPP
+#define APPEARANCE_HPP
+
+#include <list>
+#include <map>
+#include <opencv2/core.hpp>
+
+/**
+ * @class AppearanceGallery
+ * @brief A bounded LRU gallery of recently lost tracks, used to give an
+ * obstacle its old ID back when it reappears.
+ *
+ * Each track is described by a 64 bin quantized HSV histogram (8 hue x 4
+ * saturation x 2 value) of its box. The histogram is stored as the square
+ * root of its L1 normalised counts, so the Bhattacharyya coefficient of two
+ * descriptors is a single dot product.
+ */
+class AppearanceGallery {
+ public:
+  /**
+   * @brief Constructor for AppearanceGallery.
+   * @param capacity Maximum number of lost tracks remembered
+   * @param maxAge Frames after which a lost track is forgotten
+   * @param minSimilarity Bhattacharyya coefficient needed for a match
+   */
+  AppearanceGallery(std::size_t capacity = 32, int maxAge = 150,
+                    double minSimilarity = 0.85);
+
+  /**
+   * @brief Destructor for AppearanceGallery.
+   */
+  ~AppearanceGallery();
+
+  /**
+   * @brief Computes the appearance descriptor of a box. The box is clipped to
+   * the frame and reduced to a 24x24 patch before conversion to HSV, so the
+   * cost does not depend on the box size.
+   * @param frame The frame the box was found in
+   * @param box The box, in boxSpace coordinates
+   * @param boxSpace Resolution the box is given in, empty if it is in frame
+   * coordinates
+   * @return cv::Mat A 1x64 CV_32F descriptor, empty if the box is outside the
+   * frame.
+   */
+  static cv::Mat describe(const cv::Mat& frame, const cv::Rect& box,
+                          const cv::Size& boxSpace = cv::Size());
+
+  /**
+   * @brief Bhattacharyya coefficient of two descriptors.
+   * @param a First descriptor
+   * @param b Second descriptor
+   * @return double 1 for identical histograms, 0 for disjoint ones.
+   */
+  static double similarity(const cv::Mat& a, const cv::Mat& b);
+
+  /**
+   * @brief Remembers a lost track, evicting the least recently lost one when
+   * the gallery is full. An older entry with the same ID is replaced.
+   * @param id ID of the lost track
+   * @param descriptor Its last descriptor
+   */
+  void remember(int id, const cv::Mat& descriptor);
+
+  /**
+   * @brief Finds the most similar lost track that is not active again and
+   * removes it from the gallery.
+   * @param descriptor Descriptor of the new detection
+   * @param active Tracks currently in use, their IDs are never returned
+   * @return int The ID of the matching lost track, -1 if there is none.
+   */
+  int recall(const cv::Mat& descriptor, const std::map<int, cv::Rect>& active);
+
+  /**
+   * @brief Advances the gallery by one frame and forgets lost tracks older
+   * than maxAge.
+   */
+  void age();
+
+  /**
+   * @brief Forgets every lost track.
+   */
+  void clear();
+
+  /**
+   * @brief Number of lost tracks remembered.
+   * @return std::size_t The gallery size.
+   */
+  std::size_t size() const;
+
+ private:
+  /**
+   * @brief A remembered lost track.
+   */
+  struct Entry {
+    int id;              ///< ID of the lost track.
+    cv::Mat descriptor;  ///< Its last descriptor.
+    int age;             ///< Frames since it was lost.
+  };
+
+  std::size_t capacity;  ///< Maximum number of lost tracks remembered.
+  int maxAge;            ///< Frames after which a lost track is forgotten.
+  double minSimilarity;  ///< Bhattacharyya coefficient needed for a match.
+  std::list<Entry> entries;  ///< Most recently lost first.
+};
+
+#endif  // APPEARANCE_HPP
@@ -0,0 +1,170 @@
+/**
+Copyright © 2023 <copyright holders>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/**
+ * @file src.cpp
+ * @author Lowell Lobo
+ * @author Mayank Deshpande
+ * @author Kautilya Chappidi
+ * @brief Class Decleration for the AppearanceGallery
+ * @version 0.1
+ * @date 2023-11-13
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include "appearance.hpp"
+
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+
+/**
+ * @brief Default constructor.
+ * @param capacity Maximum number of lost tracks remembered
+ * @param maxAge Frames after which a lost track is forgotten
+ * @param minSimilarity Bhattacharyya coefficient needed for a match
+ */
+AppearanceGallery::AppearanceGallery(std::size_t capacity, int maxAge,
+                                     double minSimilarity)
+    : capacity(capacity), maxAge(maxAge), minSimilarity(minSimilarity) {}
+
+/**
+ * @brief Default Destructor.
+ */
+AppearanceGallery::~AppearanceGallery() {}
+
+/**
+ * @brief Computes the appearance descriptor of a box. Resizing, colour
+ * conversion, binning with cv::calcHist, square root and the later dot
+ * product all run in OpenCV's optimised kernels.
+ * @param frame The frame the box was found in
+ * @param box The box, in boxSpace coordinates
+ * @param boxSpace Resolution the box is given in
+ * @return cv::Mat A 1x64 CV_32F descriptor, empty if the box is outside the
+ * frame.
+ */
+cv::Mat AppearanceGallery::describe(const cv::Mat& frame, const cv::Rect& box,
+                                    const cv::Size& boxSpace) {
+  cv::Rect scaled = box;
+  if (!boxSpace.empty() && boxSpace != frame.size()) {
+    double scaleX = static_cast<double>(frame.cols) / boxSpace.width;
+    double scaleY = static_cast<double>(frame.rows) / boxSpace.height;
+    scaled = cv::Rect(static_cast<int>(box.x * scaleX),
+                      static_cast<int>(box.y * scaleY),
+                      static_cast<int>(box.width * scaleX),
+                      static_cast<int>(box.height * scaleY));
+  }
+  cv::Rect clipped = scaled & cv::Rect(0, 0, frame.cols, frame.rows);
+  if (clipped.empty()) {
+    return cv::Mat();
+  }
+
+  cv::Mat patch, hsv;
+  cv::resize(frame(clipped), patch, cv::Size(24, 24), 0, 0, cv::INTER_AREA);
+  cv::cvtColor(patch, hsv, cv::COLOR_BGR2HSV);
+
+  // 8 hue bins (hue is 0-179), 4 saturation and 2 value bins
+  int channels[] = {0, 1, 2};
+  int histSize[] = {8, 4, 2};
+  float hueRange[] = {0, 180}, saturationRange[] = {0, 256},
+        valueRange[] = {0, 256};
+  const float* ranges[] = {hueRange, saturationRange, valueRange};
+  cv::Mat histogram;
+  cv::calcHist(&hsv, 1, channels, cv::Mat(), histogram, 3, histSize, ranges);
+
+  cv::Mat descriptor;
+  cv::sqrt(cv::Mat(1, 64, CV_32F, histogram.ptr<float>()) *
+               (1.0 / (hsv.rows * hsv.cols)),
+           descriptor);
+  return descriptor;
+}
+
+/**
+ * @brief Bhattacharyya coefficient of two descriptors.
+ * @param a First descriptor
+ * @param b Second descriptor
+ * @return double 1 for identical histograms, 0 for disjoint ones.
+ */
+double AppearanceGallery::similarity(const cv::Mat& a, const cv::Mat& b) {
+  if (a.empty() || b.empty()) {
+    return 0.0;
+  }
+  return a.dot(b);
+}
+
+/**
+ * @brief Remembers a lost track. An older entry with the same ID is replaced,
+ * since the ID counter may have handed that ID to a different obstacle since.
+ * @param id ID of the lost track
+ * @param descriptor Its last descriptor
+ */
+void AppearanceGallery::remember(int id, const cv::Mat& descriptor) {
+  if (descriptor.empty() || capacity == 0) {
+    return;
+  }
+  entries.remove_if([id](const Entry& entry) { return entry.id == id; });
+  entries.push_front({id, descriptor, 0});
+  if (entries.size() > capacity) {
+    entries.pop_back();
+  }
+}
+
+/**
+ * @brief Finds the most similar lost track that is not active again.
+ * @param descriptor Descriptor of the new detection
+ * @param active Tracks currently in use, their IDs are never returned
+ * @return int The ID of the matching lost track, -1 if there is none.
+ */
+int AppearanceGallery::recall(const cv::Mat& descriptor,
+                              const std::map<int, cv::Rect>& active) {
+  auto best = entries.end();
+  double bestSimilarity = minSimilarity;
+  for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+    if (active.count(entry->id) > 0) {
+      continue;
+    }
+    double value = similarity(descriptor, entry->descriptor);
+    if (value >= bestSimilarity) {
+      bestSimilarity = value;
+      best = entry;
+    }
+  }
+  if (best == entries.end()) {
+    return -1;
+  }
+  int id = best->id;
+  entries.erase(best);
+  return id;
+}
+
+/**
+ * @brief Advances the gallery by one frame and forgets old lost tracks.
+ */
+void AppearanceGallery::age() {
+  for (auto entry = entries.begin(); entry != entries.end();) {
+    if (++entry->age > maxAge) {
+      entry = entries.erase(entry);
+    } else {
+      ++entry;
+    }
+  }
+}
+
+/**
+ * @brief Forgets every lost track.
+ */
+void AppearanceGallery::clear() { entries.clear(); }
+
+/**
+ * @brief Number of lost tracks remembered.
+ * @return std::size_t The gallery size.
+ */
+std::size_t AppearanceGallery::size() const { return entries.size(); }
@@ -0,0 +1,233 @@
+/**
+Copyright © 2023 <copyright holders>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+/**
+ * @file batch.hpp
+ * @author Lowell Lobo
+ * @author Mayank Deshpande
+ * @author Kautilya Chappidi
+ * @brief Class Definition for the BatchProcessor
+ * @version 0.1
+ * @date 2023-11-16
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "detection.hpp"
+
+/**
+ * @class BoundedQueue
+ * @brief A blocking FIFO with a fixed capacity, used to connect the stages of
+ * the batch pipeline so that a fast stage waits instead of buffering.
+ */
+template <typename T>
+class BoundedQueue {
+ public:
+  /**
+   * @brief Constructor for BoundedQueue.
+   * @param capacity Maximum number of queued items
+   */
+  explicit BoundedQueue(std::size_t capacity)
+      : capacity(capacity > 0 ? capacity : 1) {}
+
+  /**
+   * @brief Appends an item, waiting while the queue is full.
+   * @param item The item
+   * @return False if the queue was closed and the item was dropped.
+   */
+  bool push(T item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this]() { return closed || items.size() < capacity; });
+    if (closed) {
+      return false;
+    }
+    items.push_back(std::move(item));
+    lock.unlock();
+    notEmpty.notify_one();
+    return true;
+  }
+
+  /**
+   * @brief Removes the oldest item, waiting while the queue is empty.
+   * @param item Receives the item
+   * @return False once the queue is closed and drained.
+   */
+  bool pop(T& item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notEmpty.wait(lock, [this]() { return closed || !items.empty(); });
+    if (items.empty()) {
+      return false;
+    }
+    item = std::move(items.front());
+    items.pop_front();
+    lock.unlock();
+    notFull.notify_one();
+    return true;
+  }
+
+  /**
+   * @brief Marks the end of the input. Queued items can still be popped.
+   */
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+    }
+    notFull.notify_all();
+    notEmpty.notify_all();
+  }
+
+ private:
+  std::size_t capacity;  ///< Maximum number of queued items.
+  bool closed = false;   ///< No more items will be pushed.
+  std::deque<T> items;
+  std::mutex mutex;
+  std::condition_variable notFull, notEmpty;
+};
+
+/**
+ * @brief One image of a batch run: where it came from and what was found.
+ *
+ */
+struct BatchResult {
+  long index;                      ///< Position in the directory walk.
+  std::string path;                ///< Path of the file.
+  cv::Mat image;                   ///< Decoded image, released after inference.
+  cv::Size size;                   ///< Image size, empty if decoding failed.
+  std::vector<cv::Rect> faces;     ///< Detected faces in image coordinates.
+  std::vector<float> confidences;  ///< Confidence of every face.
+};
+
+/**
+ * @class BatchProcessor
+ * @brief Runs face detection over every image below a directory.
+ *
+ * The run is a pipeline of bounded queues: a walker thread streams paths, a
+ * pool of decode threads memory-maps each file and decodes it with
+ * cv::imdecode, the calling thread runs batched inference and a writer thread
+ * appends row groups to a columnar output file. Every stage overlaps with the
+ * others and the number of images in flight is bounded by the queue depth, the
+ * decode threads and the batch size, whatever the size of the directory.
+ *
+ * The output starts with the magic "HTBD" and a uint32 version, followed by
+ * row groups in native byte order:
+ *   uint32 imageCount, uint32 faceCount,
+ *   image columns:  int64 index, int32 width, int32 height, uint32 faces,
+ *                   uint32 pathLength, then the concatenated paths,
+ *   face columns:   int32 x, int32 y, int32 width, int32 height,
+ *                   float confidence,
+ * and ends with an empty row group. Faces are stored in image order, images
+ * that failed to decode have a zero size.
+ */
+class BatchProcessor {
+ public:
+  /**
+   * @brief Constructor for BatchProcessor.
+   * @param detector Detector used for inference, only called from run()
+   * @param decodeThreads Number of decode threads, 0 for one per core
+   * @param batchSize Images per forward pass
+   * @param queueDepth Capacity of each queue between the stages
+   */
+  BatchProcessor(DetectionClass& detector, int decodeThreads = 0,
+                 int batchSize = 8, std::size_t queueDepth = 32);
+
+  /**
+   * @brief Destructor for BatchProcessor.
+   */
+  ~BatchProcessor();
+
+  /**
+   * @brief Detects faces in every image below a directory. The pipeline
+   * threads inherit the affinity of the caller, so the caller should not be
+   * pinned to the inference cores yet; use onInferenceStart for that.
+   * @param directory Directory to walk recursively
+   * @param outputPath Columnar output file, overwritten
+   * @return True if the directory was walked and the output fully written.
+   */
+  bool run(const std::string& directory, const std::string& outputPath);
+
+  /**
+   * @brief Whether a path has an image extension the batch mode decodes.
+   * @param path File path
+   * @return True for .jpg, .jpeg, .png and .bmp in any case.
+   */
+  static bool isImagePath(const std::string& path);
+
+  /**
+   * @brief Decodes an image from a memory mapping of the file, without
+   * copying the encoded bytes into a buffer first.
+   * @param path File path
+   * @return cv::Mat The BGR image, empty if the file cannot be decoded.
+   */
+  static cv::Mat decodeFile(const std::string& path);
+
+  /**
+   * @brief Reads back an output file written by run().
+   * @param path Output file
+   * @param results Receives one entry per image, without pixel data
+   * @return True if the file is complete and well formed.
+   */
+  static bool readOutput(const std::string& path,
+                         std::vector<BatchResult>& results);
+
+  /**
+   * @brief Placement hooks, e.g. to pin the stages with ThreadPlacement.
+   * Each decode thread and the writer thread call theirs when they start.
+   * onInferenceStart is called on the calling thread only after the other
+   * threads exist, so pinning it there does not narrow their affinity.
+   */
+  std::function<void()> onDecodeStart, onWriteStart, onInferenceStart;
+
+  std::size_t rowGroupImages = 1024;  ///< Images per output row group.
+  std::atomic<long> imagesDecoded;    ///< Images decoded successfully.
+  std::atomic<long> imagesFailed;     ///< Files that could not be decoded.
+  std::atomic<long> facesWritten;     ///< Faces written to the output.
+
+ private:
+  /**
+   * @brief Streams the image paths below a directory into a queue.
+   * @param directory Directory to walk
+   * @param paths Receives the paths, numbered in walk order
+   * @param next Index of the next path
+   * @return True if the directory could be opened.
+   */
+  bool walk(const std::string& directory, BoundedQueue<BatchResult>& paths,
+            long& next);
+
+  /**
+   * @brief Body of the writer thread.
+   * @param out The output stream
+   * @param results Queue of inference results
+   * @return True if every row group was written.
+   */
+  bool writeLoop(std::ostream& out, BoundedQueue<BatchResult>& results);
+
+  DetectionClass& detector;  ///< Detector used for inference.
+  int decodeThreads;         ///< Number of decode threads.
+  int batchSize;             ///< Images per forward pass.
+  std::size_t queueDepth;    ///< Capacity of each queue.
+};
+
+#endif  // BATCH_HPP
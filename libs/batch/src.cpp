@@ -0,0 +1,449 @@
+/**
+Copyright © 2023 <copyright holders>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+/**
+ * @file src.cpp
+ * @author Lowell Lobo
+ * @author Mayank Deshpande
+ * @author Kautilya Chappidi
+ * @brief Class Decleration for the BatchProcessor
+ * @version 0.1
+ * @date 2023-11-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include "batch.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <opencv2/imgcodecs.hpp>
+#include <thread>
+
+/**
+ * @brief Appends a column to the output.
+ * @param out The output stream
+ * @param column Values of the column
+ */
+template <typename T>
+static void writeColumn(std::ostream& out, const std::vector<T>& column) {
+  if (!column.empty()) {
+    out.write(reinterpret_cast<const char*>(column.data()),
+              column.size() * sizeof(T));
+  }
+}
+
+/**
+ * @brief Reads a column from the output.
+ * @param in The input stream
+ * @param column Receives the values
+ * @param count Number of values
+ * @return True if the column was read completely.
+ */
+template <typename T>
+static bool readColumn(std::istream& in, std::vector<T>& column,
+                       std::size_t count) {
+  column.resize(count);
+  if (count > 0) {
+    in.read(reinterpret_cast<char*>(column.data()), count * sizeof(T));
+  }
+  return static_cast<bool>(in);
+}
+
+static const char kMagic[4] = {'H', 'T', 'B', 'D'};
+static const std::uint32_t kVersion = 1;
+
+/**
+ * @brief Constructor for BatchProcessor.
+ * @param detector Detector used for inference
+ * @param decodeThreads Number of decode threads, 0 for one per core
+ * @param batchSize Images per forward pass
+ * @param queueDepth Capacity of each queue between the stages
+ */
+BatchProcessor::BatchProcessor(DetectionClass& detector, int decodeThreads,
+                               int batchSize, std::size_t queueDepth)
+    : imagesDecoded(0),
+      imagesFailed(0),
+      facesWritten(0),
+      detector(detector),
+      decodeThreads(decodeThreads > 0
+                        ? decodeThreads
+                        : std::max(1u, std::thread::hardware_concurrency())),
+      batchSize(std::max(1, batchSize)),
+      queueDepth(std::max<std::size_t>(1, queueDepth)) {}
+
+/**
+ * @brief Default Destructor.
+ */
+BatchProcessor::~BatchProcessor() {}
+
+/**
+ * @brief Detects faces in every image below a directory. Decoded images are
+ * grouped into batches in the order they finish decoding; the index column of
+ * the output keeps the walk order.
+ * @param directory Directory to walk recursively
+ * @param outputPath Columnar output file, overwritten
+ * @return True if the directory was walked and the output fully written.
+ */
+bool BatchProcessor::run(const std::string& directory,
+                         const std::string& outputPath) {
+  std::ofstream out(outputPath, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    std::cerr << "Cannot write " << outputPath << std::endl;
+    return false;
+  }
+  imagesDecoded = 0;
+  imagesFailed = 0;
+  facesWritten = 0;
+
+  BoundedQueue<BatchResult> paths(queueDepth), decoded(queueDepth),
+      results(queueDepth);
+
+  bool walked = false;
+  std::thread walker([&]() {
+    long next = 0;
+    walked = walk(directory, paths, next);
+    paths.close();
+  });
+
+  std::atomic<int> decoding(decodeThreads);
+  std::vector<std::thread> decoders;
+  for (int i = 0; i < decodeThreads; i++) {
+    decoders.emplace_back([&]() {
+      if (onDecodeStart) {
+        onDecodeStart();
+      }
+      BatchResult item;
+      while (paths.pop(item)) {
+        item.image = decodeFile(item.path);
+        item.size = item.image.size();
+        (item.image.empty() ? imagesFailed : imagesDecoded)++;
+        decoded.push(std::move(item));
+      }
+      if (--decoding == 0) {
+        decoded.close();
+      }
+    });
+  }
+
+  bool written = false;
+  std::thread writer([&]() {
+    if (onWriteStart) {
+      onWriteStart();
+    }
+    written = writeLoop(out, results);
+  });
+
+  // Inference runs on the calling thread. It is placed only now, after the
+  // other stages have started with the affinity of the caller
+  if (onInferenceStart) {
+    onInferenceStart();
+  }
+  bool inferred = true;
+  std::vector<BatchResult> batch;
+  std::vector<cv::Mat> frames;
+  std::vector<std::vector<float>> confidences;
+  auto flush = [&]() {
+    frames.clear();
+    for (const auto& item : batch) {
+      if (!item.image.empty()) {
+        frames.push_back(item.image);
+      }
+    }
+    try {
+      auto faces = detector.detectFacesBatch(frames, confidences);
+      std::size_t frame = 0;
+      for (auto& item : batch) {
+        if (!item.image.empty()) {
+          item.faces.swap(faces[frame]);
+          item.confidences.swap(confidences[frame]);
+          frame++;
+        }
+        item.image.release();
+        results.push(std::move(item));
+      }
+    } catch (const cv::Exception& e) {
+      std::cerr << "Batch inference failed: " << e.what() << std::endl;
+      inferred = false;
+    }
+    frames.clear();
+    batch.clear();
+  };
+
+  BatchResult item;
+  while (decoded.pop(item)) {
+    if (!inferred) {
+      continue;  // drain so that the decode threads can finish
+    }
+    batch.push_back(std::move(item));
+    if (batch.size() >= static_cast<std::size_t>(batchSize)) {
+      flush();
+    }
+  }
+  if (inferred && !batch.empty()) {
+    flush();
+  }
+  results.close();
+
+  walker.join();
+  for (auto& decoder : decoders) {
+    decoder.join();
+  }
+  writer.join();
+  if (!walked) {
+    std::cerr << "Cannot open directory " << directory << std::endl;
+  }
+  return walked && inferred && written;
+}
+
+/**
+ * @brief Whether a path has an image extension the batch mode decodes.
+ * @param path File path
+ * @return True for .jpg, .jpeg, .png and .bmp in any case.
+ */
+bool BatchProcessor::isImagePath(const std::string& path) {
+  std::size_t dot = path.rfind('.');
+  if (dot == std::string::npos) {
+    return false;
+  }
+  std::string extension = path.substr(dot + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return extension == "jpg" || extension == "jpeg" || extension == "png" ||
+         extension == "bmp";
+}
+
+/**
+ * @brief Decodes an image from a memory mapping of the file. The pages are
+ * read by the decoder straight from the page cache and unmapped afterwards,
+ * so no encoded copy stays on the heap.
+ * @param path File path
+ * @return cv::Mat The BGR image, empty if the file cannot be decoded.
+ */
+cv::Mat BatchProcessor::decodeFile(const std::string& path) {
+  cv::Mat image;
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return image;
+  }
+  struct stat info;
+  if (fstat(fd, &info) == 0 && info.st_size > 0 && info.st_size <= INT_MAX) {
+    std::size_t length = static_cast<std::size_t>(info.st_size);
+    void* data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      madvise(data, length, MADV_SEQUENTIAL);
+      cv::Mat encoded(1, static_cast<int>(length), CV_8UC1, data);
+      try {
+        image = cv::imdecode(encoded, cv::IMREAD_COLOR);
+      } catch (const cv::Exception&) {
+        image.release();
+      }
+      munmap(data, length);
+    }
+  }
+  close(fd);
+  return image;
+}
+
+/**
+ * @brief Reads back an output file written by run().
+ * @param path Output file
+ * @param results Receives one entry per image, without pixel data
+ * @return True if the file is complete and well formed.
+ */
+bool BatchProcessor::readOutput(const std::string& path,
+                                std::vector<BatchResult>& results) {
+  results.clear();
+  std::ifstream in(path, std::ios::binary);
+  char magic[4];
+  std::uint32_t version = 0;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(&version), sizeof(version));
+  if (!in || !std::equal(magic, magic + 4, kMagic) || version != kVersion) {
+    return false;
+  }
+
+  std::vector<std::int64_t> index;
+  std::vector<std::int32_t> width, height, x, y, boxWidth, boxHeight;
+  std::vector<std::uint32_t> faces, pathLength;
+  std::vector<float> confidence;
+  std::vector<char> paths;
+  while (true) {
+    std::uint32_t imageCount = 0, faceCount = 0;
+    in.read(reinterpret_cast<char*>(&imageCount), sizeof(imageCount));
+    in.read(reinterpret_cast<char*>(&faceCount), sizeof(faceCount));
+    if (!in) {
+      return false;
+    }
+    if (imageCount == 0) {
+      return true;
+    }
+    if (!readColumn(in, index, imageCount) ||
+        !readColumn(in, width, imageCount) ||
+        !readColumn(in, height, imageCount) ||
+        !readColumn(in, faces, imageCount) ||
+        !readColumn(in, pathLength, imageCount)) {
+      return false;
+    }
+    std::size_t pathBytes = 0, faceTotal = 0;
+    for (std::uint32_t i = 0; i < imageCount; i++) {
+      pathBytes += pathLength[i];
+      faceTotal += faces[i];
+    }
+    if (faceTotal != faceCount || !readColumn(in, paths, pathBytes) ||
+        !readColumn(in, x, faceCount) || !readColumn(in, y, faceCount) ||
+        !readColumn(in, boxWidth, faceCount) ||
+        !readColumn(in, boxHeight, faceCount) ||
+        !readColumn(in, confidence, faceCount)) {
+      return false;
+    }
+
+    std::size_t pathOffset = 0, face = 0;
+    for (std::uint32_t i = 0; i < imageCount; i++) {
+      BatchResult result;
+      result.index = static_cast<long>(index[i]);
+      result.path.assign(paths.data() + pathOffset, pathLength[i]);
+      result.size = cv::Size(width[i], height[i]);
+      for (std::uint32_t f = 0; f < faces[i]; f++, face++) {
+        result.faces.push_back(
+            cv::Rect(x[face], y[face], boxWidth[face], boxHeight[face]));
+        result.confidences.push_back(confidence[face]);
+      }
+      pathOffset += pathLength[i];
+      results.push_back(std::move(result));
+    }
+  }
+}
+
+/**
+ * @brief Streams the image paths below a directory into a queue. Entries are
+ * visited as readdir returns them and subdirectories depth first, so only the
+ * open directory handles and the queue are held in memory.
+ * @param directory Directory to walk
+ * @param paths Receives the paths, numbered in walk order
+ * @param next Index of the next path
+ * @return True if the directory could be opened.
+ */
+bool BatchProcessor::walk(const std::string& directory,
+                          BoundedQueue<BatchResult>& paths, long& next) {
+  DIR* handle = opendir(directory.c_str());
+  if (handle == nullptr) {
+    return false;
+  }
+  while (struct dirent* entry = readdir(handle)) {
+    std::string name = entry->d_name;
+    if (name == "." || name == "..") {
+      continue;
+    }
+    std::string path = directory + "/" + name;
+    bool isDirectory = entry->d_type == DT_DIR;
+    bool isFile = entry->d_type == DT_REG;
+    if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+      struct stat info;
+      if (stat(path.c_str(), &info) == 0) {
+        isDirectory = S_ISDIR(info.st_mode) && entry->d_type != DT_LNK;
+        isFile = S_ISREG(info.st_mode);
+      }
+    }
+    if (isDirectory) {
+      walk(path, paths, next);
+    } else if (isFile && isImagePath(path)) {
+      BatchResult item;
+      item.index = next++;
+      item.path = path;
+      paths.push(std::move(item));
+    }
+  }
+  closedir(handle);
+  return true;
+}
+
+/**
+ * @brief Body of the writer thread. Collects results into the columns of a
+ * row group and writes the group once it holds rowGroupImages images.
+ * @param out The output stream
+ * @param results Queue of inference results
+ * @return True if every row group was written.
+ */
+bool BatchProcessor::writeLoop(std::ostream& out,
+                               BoundedQueue<BatchResult>& results) {
+  out.write(kMagic, sizeof(kMagic));
+  out.write(reinterpret_cast<const char*>(&kVersion), sizeof(kVersion));
+
+  std::vector<std::int64_t> index;
+  std::vector<std::int32_t> width, height, x, y, boxWidth, boxHeight;
+  std::vector<std::uint32_t> faces, pathLength;
+  std::vector<float> confidence;
+  std::vector<char> paths;
+  auto writeGroup = [&]() {
+    std::uint32_t imageCount = static_cast<std::uint32_t>(index.size());
+    std::uint32_t faceCount = static_cast<std::uint32_t>(x.size());
+    out.write(reinterpret_cast<const char*>(&imageCount), sizeof(imageCount));
+    out.write(reinterpret_cast<const char*>(&faceCount), sizeof(faceCount));
+    writeColumn(out, index);
+    writeColumn(out, width);
+    writeColumn(out, height);
+    writeColumn(out, faces);
+    writeColumn(out, pathLength);
+    writeColumn(out, paths);
+    writeColumn(out, x);
+    writeColumn(out, y);
+    writeColumn(out, boxWidth);
+    writeColumn(out, boxHeight);
+    writeColumn(out, confidence);
+    facesWritten += faceCount;
+    for (auto* column : {&width, &height, &x, &y, &boxWidth, &boxHeight}) {
+      column->clear();
+    }
+    index.clear();
+    faces.clear();
+    pathLength.clear();
+    confidence.clear();
+    paths.clear();
+  };
+
+  BatchResult result;
+  while (results.pop(result)) {
+    index.push_back(result.index);
+    width.push_back(result.size.width);
+    height.push_back(result.size.height);
+    faces.push_back(static_cast<std::uint32_t>(result.faces.size()));
+    pathLength.push_back(static_cast<std::uint32_t>(result.path.size()));
+    paths.insert(paths.end(), result.path.begin(), result.path.end());
+    for (std::size_t i = 0; i < result.faces.size(); i++) {
+      x.push_back(result.faces[i].x);
+      y.push_back(result.faces[i].y);
+      boxWidth.push_back(result.faces[i].width);
+      boxHeight.push_back(result.faces[i].height);
+      confidence.push_back(result.confidences[i]);
+    }
+    if (index.size() >= rowGroupImages) {
+      writeGroup();
+    }
+  }
+  if (!index.empty()) {
+    writeGroup();
+  }
+  writeGroup();  // an empty row group marks the end of the file
+  out.flush();
+  return static_cast<bool>(out);
+}
@@ -0,0 +1,133 @@
+/**
+Copyright © 2023 <copyright holders>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+/**
+ * @file checkpoint.hpp
+ * @author Lowell Lobo
+ * @author Mayank Deshpande
+ * @author Kautilya Chappidi
+ * @brief Class Definition for the TrackerCheckpoint
+ * @version 0.1
+ * @date 2023-11-17
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "tracking.hpp"
+
+/**
+ * @class TrackerCheckpoint
+ * @brief Periodically saves the tracker state so that a restarted process can
+ * resume with the same obstacle IDs.
+ *
+ * publish() is called from the perception loop. When a snapshot is due it
+ * copies the state into a buffer it owns and swaps that buffer with the
+ * pending one, so the loop only holds the lock for the swap. A writer thread
+ * swaps the pending buffer out again and writes it to a temporary file that is
+ * synced and renamed over the checkpoint, so a crash never leaves a torn file,
+ * and then syncs the directory so that the rename survives a power loss.
+ * Buffers are reused, so steady state snapshots do not allocate in the loop.
+ *
+ * The file holds the magic "HTCK", a uint32 version, the int64 wall clock
+ * time of the snapshot in milliseconds, the int32 ID counter, a uint32 track
+ * count, per track the int32 ID, x, y, width, height and missed frames, and
+ * an FNV-1a checksum of everything before it, all in native byte order.
+ */
+class TrackerCheckpoint {
+ public:
+  /**
+   * @brief Constructor for TrackerCheckpoint, starts the writer thread.
+   * @param path Checkpoint file, empty disables checkpointing
+   * @param intervalSeconds Minimum time between two snapshots
+   */
+  explicit TrackerCheckpoint(const std::string& path,
+                             double intervalSeconds = 0.2);
+
+  /**
+   * @brief Destructor for TrackerCheckpoint, writes the last pending snapshot
+   * and joins the writer thread.
+   */
+  ~TrackerCheckpoint();
+
+  /**
+   * @brief Hands a snapshot of the tracker to the writer thread if the
+   * interval has elapsed, otherwise returns at once.
+   * @param tracker The tracker to snapshot
+   * @return True if a snapshot was taken.
+   */
+  bool publish(const TrackingClass& tracker);
+
+  /**
+   * @brief Writes a checkpoint file atomically.
+   * @param path Checkpoint file
+   * @param state The state to save
+   * @param timestampMs Wall clock time of the state in milliseconds
+   * @return True if the file was written, synced, renamed into place and its
+   * directory synced.
+   */
+  static bool save(const std::string& path, const TrackerState& state,
+                   std::int64_t timestampMs);
+
+  /**
+   * @brief Reads a checkpoint file for a warm start.
+   * @param path Checkpoint file
+   * @param state Receives the state, untouched on failure
+   * @param maxAgeSeconds Oldest snapshot that is still accepted
+   * @param ageSeconds Receives the age of the snapshot, may be null
+   * @return True if the file exists, is intact and recent enough.
+   */
+  static bool load(const std::string& path, TrackerState& state,
+                   double maxAgeSeconds, double* ageSeconds = nullptr);
+
+  /**
+   * @brief Current wall clock time as stored in checkpoint files.
+   * @return std::int64_t Milliseconds since the epoch.
+   */
+  static std::int64_t nowMs();
+
+  std::atomic<long> snapshotsWritten;  ///< Checkpoint files written.
+  std::atomic<long> writeFailures;     ///< Checkpoint files that failed.
+
+ private:
+  /**
+   * @brief Body of the writer thread.
+   */
+  void writeLoop();
+
+  std::string path;  ///< Checkpoint file, empty if disabled.
+  std::chrono::steady_clock::duration interval;  ///< Time between snapshots.
+  std::chrono::steady_clock::time_point nextSnapshot;  ///< Next due snapshot.
+
+  TrackerState staging;  ///< Filled by publish() without holding the lock.
+  std::int64_t stagingMs = 0;
+  std::mutex pendingMutex;  ///< Guards the pending buffer.
+  std::condition_variable pendingReady;
+  bool pending = false;   ///< A snapshot is waiting to be written.
+  bool stopping = false;  ///< The destructor asked the thread to exit.
+  TrackerState pendingState;  ///< Swapped between publish() and the writer.
+  std::int64_t pendingMs = 0;
+
+  std::thread writerThread;  ///< Started last, joined by the destructor.
+};
+
+#endif  // CHECKPOINT_HPP
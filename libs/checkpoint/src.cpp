@@ -0,0 +1,297 @@
+/**
+Copyright © 2023 <copyright holders>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+
+/**
+ * @file src.cpp
+ * @author Lowell Lobo
+ * @author Mayank Deshpande
+ * @author Kautilya Chappidi
+ * @brief Class Decleration for the TrackerCheckpoint
+ * @version 0.1
+ * @date 2023-11-17
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include "checkpoint.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+static const char kMagic[4] = {'H', 'T', 'C', 'K'};
+static const std::uint32_t kVersion = 1;
+static const std::size_t kHeaderBytes = 4 + 4 + 8 + 4 + 4;
+static const std::size_t kTrackBytes = 6 * 4;
+
+/**
+ * @brief Appends a value to the checkpoint buffer.
+ * @param buffer The buffer
+ * @param value The value
+ */
+template <typename T>
+static void append(std::vector<char>& buffer, T value) {
+  const char* bytes = reinterpret_cast<const char*>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+/**
+ * @brief Reads a value from the checkpoint buffer.
+ * @param buffer The buffer
+ * @param offset Position of the value, advanced past it
+ * @return T The value.
+ */
+template <typename T>
+static T extract(const std::vector<char>& buffer, std::size_t& offset) {
+  T value;
+  std::memcpy(&value, buffer.data() + offset, sizeof(T));
+  offset += sizeof(T);
+  return value;
+}
+
+/**
+ * @brief 32 bit FNV-1a hash, enough to reject torn or corrupted files.
+ * @param data The bytes
+ * @param size Number of bytes
+ * @return std::uint32_t The hash.
+ */
+static std::uint32_t fnv1a(const char* data, std::size_t size) {
+  std::uint32_t hash = 2166136261u;
+  for (std::size_t i = 0; i < size; i++) {
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * @brief Constructor, starts the writer thread unless checkpointing is
+ * disabled.
+ * @param path Checkpoint file, empty disables checkpointing
+ * @param intervalSeconds Minimum time between two snapshots
+ */
+TrackerCheckpoint::TrackerCheckpoint(const std::string& path,
+                                     double intervalSeconds)
+    : snapshotsWritten(0),
+      writeFailures(0),
+      path(path),
+      interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(std::max(0.0, intervalSeconds)))),
+      nextSnapshot(std::chrono::steady_clock::now()) {
+  if (!path.empty()) {
+    writerThread = std::thread(&TrackerCheckpoint::writeLoop, this);
+  }
+}
+
+/**
+ * @brief Default Destructor, writes the last pending snapshot and joins the
+ * writer thread.
+ */
+TrackerCheckpoint::~TrackerCheckpoint() {
+  if (!writerThread.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    stopping = true;
+  }
+  pendingReady.notify_one();
+  writerThread.join();
+}
+
+/**
+ * @brief Hands a snapshot of the tracker to the writer thread if the interval
+ * has elapsed. The copy goes into the staging buffer, which only this thread
+ * touches; the lock is held just to swap it with the pending buffer.
+ * @param tracker The tracker to snapshot
+ * @return True if a snapshot was taken.
+ */
+bool TrackerCheckpoint::publish(const TrackingClass& tracker) {
+  auto now = std::chrono::steady_clock::now();
+  if (path.empty() || now < nextSnapshot) {
+    return false;
+  }
+  nextSnapshot = now + interval;
+
+  tracker.snapshot(staging);
+  stagingMs = nowMs();
+  {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    std::swap(staging, pendingState);
+    std::swap(stagingMs, pendingMs);
+    pending = true;
+  }
+  pendingReady.notify_one();
+  return true;
+}
+
+/**
+ * @brief Writes a checkpoint file atomically: the data is written to a
+ * temporary file next to the checkpoint, synced and renamed over it. The
+ * directory is synced after the rename, since until then a power loss can
+ * still bring back the old directory entry.
+ * @param path Checkpoint file
+ * @param state The state to save
+ * @param timestampMs Wall clock time of the state in milliseconds
+ * @return True if the file was written, synced, renamed into place and its
+ * directory synced.
+ */
+bool TrackerCheckpoint::save(const std::string& path, const TrackerState& state,
+                             std::int64_t timestampMs) {
+  std::vector<char> buffer;
+  buffer.reserve(kHeaderBytes + state.tracks.size() * kTrackBytes + 4);
+  buffer.insert(buffer.end(), kMagic, kMagic + sizeof(kMagic));
+  append(buffer, kVersion);
+  append(buffer, timestampMs);
+  append(buffer, static_cast<std::int32_t>(state.count));
+  append(buffer, static_cast<std::uint32_t>(state.tracks.size()));
+  for (const auto& track : state.tracks) {
+    auto missed = state.missedFrames.find(track.first);
+    int missedFrames = missed == state.missedFrames.end() ? 0 : missed->second;
+    append(buffer, static_cast<std::int32_t>(track.first));
+    append(buffer, static_cast<std::int32_t>(track.second.x));
+    append(buffer, static_cast<std::int32_t>(track.second.y));
+    append(buffer, static_cast<std::int32_t>(track.second.width));
+    append(buffer, static_cast<std::int32_t>(track.second.height));
+    append(buffer, static_cast<std::int32_t>(missedFrames));
+  }
+  append(buffer, fnv1a(buffer.data(), buffer.size()));
+
+  std::string temporary = path + ".tmp";
+  int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644);
+  if (fd < 0) {
+    return false;
+  }
+  std::size_t written = 0;
+  while (written < buffer.size()) {
+    ssize_t result =
+        write(fd, buffer.data() + written, buffer.size() - written);
+    if (result <= 0) {
+      break;
+    }
+    written += static_cast<std::size_t>(result);
+  }
+  bool ok = written == buffer.size() && fsync(fd) == 0;
+  ok = close(fd) == 0 && ok;
+  if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+
+  std::string::size_type slash = path.find_last_of('/');
+  std::string directory =
+      slash == std::string::npos ? "." : path.substr(0, slash + 1);
+  int directoryFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (directoryFd < 0) {
+    return false;
+  }
+  ok = fsync(directoryFd) == 0;
+  close(directoryFd);
+  return ok;
+}
+
+/**
+ * @brief Reads a checkpoint file for a warm start. Missing, truncated,
+ * corrupted and stale files are rejected so that the tracker starts cold.
+ * @param path Checkpoint file
+ * @param state Receives the state, untouched on failure
+ * @param maxAgeSeconds Oldest snapshot that is still accepted
+ * @param ageSeconds Receives the age of the snapshot, may be null
+ * @return True if the file exists, is intact and recent enough.
+ */
+bool TrackerCheckpoint::load(const std::string& path, TrackerState& state,
+                             double maxAgeSeconds, double* ageSeconds) {
+  std::ifstream file(path, std::ios::binary);
+  std::vector<char> buffer((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+  if (buffer.size() < kHeaderBytes + 4 ||
+      !std::equal(kMagic, kMagic + sizeof(kMagic), buffer.begin())) {
+    return false;
+  }
+  std::size_t checksumOffset = buffer.size() - 4;
+  std::size_t offset = checksumOffset;
+  if (extract<std::uint32_t>(buffer, offset) !=
+      fnv1a(buffer.data(), checksumOffset)) {
+    return false;
+  }
+
+  offset = sizeof(kMagic);
+  std::uint32_t version = extract<std::uint32_t>(buffer, offset);
+  std::int64_t timestampMs = extract<std::int64_t>(buffer, offset);
+  std::int32_t count = extract<std::int32_t>(buffer, offset);
+  std::uint32_t tracks = extract<std::uint32_t>(buffer, offset);
+  if (version != kVersion ||
+      checksumOffset != kHeaderBytes + std::size_t(tracks) * kTrackBytes) {
+    return false;
+  }
+  double age = (nowMs() - timestampMs) / 1000.0;
+  if (ageSeconds != nullptr) {
+    *ageSeconds = age;
+  }
+  if (std::fabs(age) > maxAgeSeconds) {
+    return false;
+  }
+
+  TrackerState loaded;
+  loaded.count = count;
+  for (std::uint32_t i = 0; i < tracks; i++) {
+    int id = extract<std::int32_t>(buffer, offset);
+    int x = extract<std::int32_t>(buffer, offset);
+    int y = extract<std::int32_t>(buffer, offset);
+    int width = extract<std::int32_t>(buffer, offset);
+    int height = extract<std::int32_t>(buffer, offset);
+    loaded.tracks[id] = cv::Rect(x, y, width, height);
+    loaded.missedFrames[id] = extract<std::int32_t>(buffer, offset);
+  }
+  state = std::move(loaded);
+  return true;
+}
+
+/**
+ * @brief Current wall clock time as stored in checkpoint files. The wall
+ * clock is used because the age has to be measured across process restarts.
+ * @return std::int64_t Milliseconds since the epoch.
+ */
+std::int64_t TrackerCheckpoint::nowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * @brief Body of the writer thread. Swaps the pending snapshot out and writes
+ * it without holding the lock, so a slow disk never blocks publish().
+ */
+void TrackerCheckpoint::writeLoop() {
+  TrackerState writing;
+  std::int64_t writingMs = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(pendingMutex);
+      pendingReady.wait(lock, [this]() { return pending || stopping; });
+      if (!pending) {
+        return;
+      }
+      std::swap(writing, pendingState);
+      std::swap(writingMs, pendingMs);
+      pending = false;
+    }
+    (save(path, writing, writingMs) ? snapshotsWritten : writeFailures)++;
+  }
+}
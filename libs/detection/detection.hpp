@@ -28,6 +28,28 @@ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR I
 #include <opencv2/opencv.hpp>
 #include <vector>  // for using std::vector
 
+/**
+ * @brief The cheap first stage that decides whether a frame is worth a full
+ * resolution SSD pass.
+ *
+ */
+enum class PrefilterMode {
+  kNone,       ///< Every frame goes through the full SSD.
+  kLowResNet,  ///< A low resolution pass of the same network.
+  kCascade     ///< A Haar or LBP cv::CascadeClassifier.
+};
+
+/**
+ * @brief A frame read by DetectionClass::readFrame(), at the working
+ * resolution used for detection and optionally at the source resolution.
+ *
+ */
+struct VideoFrame {
+  cv::Mat full;       ///< Source resolution frame, empty if not kept.
+  cv::Mat working;    ///< Frame at the working resolution.
+  cv::Size fullSize;  ///< Resolution of the source.
+};
+
 /**
  * @class DetectionClass
  * @brief A class for performing face detection using a deep learning model.
@@ -58,18 +80,110 @@ class DetectionClass {
    */
   bool initVideoStream(int deviceID);
 
+  /**
+   * @brief Initialize a video stream that delivers frames at a working
+   * resolution and optionally at a reduced frame rate.
+   *
+   * When the full resolution frame is not needed and OpenCV has the GStreamer
+   * backend, decoding, rate reduction and scaling happen in the decoder
+   * pipeline and only working resolution BGR frames are produced. Otherwise,
+   * including whenever keepFullResolution is set, frames are decoded at the
+   * source resolution, decimated with grab() without retrieve() and scaled
+   * with INTER_AREA.
+   *
+   * @param source Camera index ("0"), file path or URI. A camera index that
+   * does not fit an int fails to open.
+   * @param workingSize Resolution for detection, empty keeps the source size.
+   * @param keepFullResolution Also deliver the source resolution frame.
+   * @param targetFps Maximum frame rate to deliver, 0 delivers every frame.
+   * @return True if the video stream is successfully opened, false otherwise.
+   */
+  bool initVideoStream(const std::string& source, const cv::Size& workingSize,
+                       bool keepFullResolution, double targetFps = 0);
+
+  /**
+   * @brief Read the next frame that survives decimation.
+   * @param frame Receives the working and, if kept, full resolution frame.
+   * The previous contents are released, not overwritten, so frames handed to
+   * other threads stay intact.
+   * @return True if a frame was read, false at the end of the stream.
+   */
+  bool readFrame(VideoFrame& frame);
+
+  /**
+   * @brief Map boxes found in the working frame back to source resolution.
+   * @param boxes Boxes in working frame coordinates.
+   * @param frame The frame the boxes were found in.
+   * @return A vector of cv::Rect in source resolution coordinates.
+   */
+  static std::vector<cv::Rect> mapToFullResolution(
+      const std::vector<cv::Rect>& boxes, const VideoFrame& frame);
+
   /**
    * @brief Detect faces in the current frame obtained from the video stream.
    * @return A vector of cv::Rect representing the detected faces' bounding
    * boxes and draw rectangle.
    */
   std::vector<cv::Rect> detectFaces(cv::Mat& frame);
+
+  /**
+   * @brief Detect faces in several images with a single forward pass. Images
+   * may differ in size; each is scaled to the 300x300 network input. The
+   * prefilter is not applied.
+   * @param frames Images to detect faces in.
+   * @param confidences Receives the confidence of every returned box.
+   * @return One vector of cv::Rect per image, in that image's coordinates.
+   */
+  std::vector<std::vector<cv::Rect>> detectFacesBatch(
+      const std::vector<cv::Mat>& frames,
+      std::vector<std::vector<float>>& confidences);
+
+  /**
+   * @brief Enables a cheap first detection stage. detectFaces() then runs the
+   * full SSD only on frames where the first stage proposes a candidate and
+   * returns no detections for the others.
+   * @param mode The first stage to use, kNone disables the prefilter.
+   * @param cascadePath Haar or LBP cascade file, only used by kCascade.
+   * @return True if the stage is ready, false if the cascade failed to load.
+   */
+  bool enablePrefilter(PrefilterMode mode, const std::string& cascadePath = "");
+
   cv::VideoCapture videoCapture;  ///< Video capture object for accessing frames
                                   ///< from the camera.
+  int framesScreened = 0;  ///< Frames that went through the prefilter.
+  int framesRejected = 0;  ///< Frames the prefilter kept from the full SSD.
 
  private:
+  /**
+   * @brief Runs a face detection network once.
+   * @param net The network to run.
+   * @param frame Image to detect faces in.
+   * @param inputSize Network input resolution.
+   * @param threshold Minimum confidence of a returned detection.
+   * @return A vector of cv::Rect in frame coordinates.
+   */
+  std::vector<cv::Rect> forwardPass(cv::dnn::Net& net, const cv::Mat& frame,
+                                    const cv::Size& inputSize,
+                                    float threshold);
+
+  /**
+   * @brief Asks the prefilter whether the frame may contain a face.
+   * @param frame Image to screen.
+   * @return True if the full SSD should run on the frame.
+   */
+  bool passesPrefilter(const cv::Mat& frame);
+
+  cv::Size workingSize;     ///< Working resolution, empty for source size.
+  bool keepFullResolution = true;  ///< Deliver the source resolution frame.
+  bool decoderScaling = false;  ///< The decoder pipeline does the scaling.
+  cv::Size sourceSize;      ///< Resolution of the opened source.
+  int frameStride = 1;      ///< Deliver one out of every frameStride frames.
   cv::dnn::Net faceDetectionModel;  ///< Deep learning face detection model.
   float confidenceThreshold = 0.5;
+  PrefilterMode prefilterMode = PrefilterMode::kNone;
+  cv::CascadeClassifier prefilterCascade;  ///< Used by kCascade.
+  cv::Size prefilterSize = cv::Size(128, 128);  ///< kLowResNet input size.
+  float prefilterThreshold = 0.2;  ///< Deliberately lax to avoid misses.
 };
 
 #endif  // DETECTION_HPP
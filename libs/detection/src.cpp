@@ -23,6 +23,12 @@ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR I
  */
 #include "detection.hpp"
 
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <opencv2/videoio/registry.hpp>
+
 /**
  * @brief Constructor for the DetectionClass.
  * @param modelPath Path to the pre-trained face detection model file.
@@ -55,27 +61,261 @@ bool DetectionClass::initVideoStream(int deviceID) {
   return videoCapture.isOpened();
 }
 
+/**
+ * @brief Initialize a video stream that delivers frames at a working
+ * resolution and optionally at a reduced frame rate. The decoder pipeline
+ * ends in a single appsink, so it is only used when the source resolution
+ * frame is not kept; a tee would need a second sink that cv::VideoCapture
+ * cannot read from.
+ * @param source Camera index ("0"), file path or URI.
+ * @param workingSize Resolution for detection, empty keeps the source size.
+ * @param keepFullResolution Also deliver the source resolution frame.
+ * @param targetFps Maximum frame rate to deliver, 0 delivers every frame.
+ * @return True if the video stream is successfully opened, false otherwise.
+ */
+bool DetectionClass::initVideoStream(const std::string& source,
+                                     const cv::Size& workingSize,
+                                     bool keepFullResolution,
+                                     double targetFps) {
+  this->workingSize = workingSize;
+  this->keepFullResolution = keepFullResolution || workingSize.empty();
+  decoderScaling = false;
+  frameStride = 1;
+  videoCapture.release();
+
+  // A source made of digits only is a camera index, which must fit an int
+  bool isCamera = !source.empty() &&
+                  source.find_first_not_of("0123456789") == std::string::npos;
+  if (isCamera) {
+    errno = 0;
+    long index = std::strtol(source.c_str(), nullptr, 10);
+    if (errno == ERANGE || index > INT_MAX) {
+      return false;
+    }
+    videoCapture.open(static_cast<int>(index));
+    if (videoCapture.isOpened() && !this->keepFullResolution) {
+      // Ask the camera for the working resolution, it may pick the nearest
+      videoCapture.set(cv::CAP_PROP_FRAME_WIDTH, workingSize.width);
+      videoCapture.set(cv::CAP_PROP_FRAME_HEIGHT, workingSize.height);
+    }
+  } else {
+    videoCapture.open(source);
+  }
+  if (!videoCapture.isOpened()) {
+    return false;
+  }
+  sourceSize = cv::Size(
+      static_cast<int>(videoCapture.get(cv::CAP_PROP_FRAME_WIDTH)),
+      static_cast<int>(videoCapture.get(cv::CAP_PROP_FRAME_HEIGHT)));
+  double sourceFps = videoCapture.get(cv::CAP_PROP_FPS);
+
+  if (!isCamera && !this->keepFullResolution &&
+      cv::videoio_registry::hasBackend(cv::CAP_GSTREAMER)) {
+    // Scale in the decoder's colour space before converting to BGR, and drop
+    // frames before either step
+    std::string input = source.find("://") == std::string::npos
+                            ? "filesrc location=\"" + source + "\" ! decodebin"
+                            : "uridecodebin uri=\"" + source + "\"";
+    std::string rate =
+        targetFps > 0 ? " ! videorate drop-only=true ! video/x-raw,framerate=" +
+                            std::to_string(static_cast<int>(targetFps * 1000)) +
+                            "/1000"
+                      : "";
+    std::string pipeline =
+        input + rate + " ! videoscale ! video/x-raw,width=" +
+        std::to_string(workingSize.width) +
+        ",height=" + std::to_string(workingSize.height) +
+        " ! videoconvert ! video/x-raw,format=BGR ! appsink";
+    cv::VideoCapture scaled(pipeline, cv::CAP_GSTREAMER);
+    if (scaled.isOpened()) {
+      videoCapture = scaled;
+      decoderScaling = true;
+      return true;
+    }
+  }
+
+  if (targetFps > 0 && sourceFps > targetFps) {
+    frameStride = static_cast<int>(std::round(sourceFps / targetFps));
+  }
+  return true;
+}
+
+/**
+ * @brief Read the next frame that survives decimation. Skipped frames are only
+ * grabbed, which decodes them but avoids the colour conversion and copy of
+ * retrieve().
+ * @param frame Receives the working and, if kept, full resolution frame.
+ * @return True if a frame was read, false at the end of the stream.
+ */
+bool DetectionClass::readFrame(VideoFrame& frame) {
+  frame.full.release();
+  frame.working.release();
+
+  for (int i = 1; i < frameStride; i++) {
+    if (!videoCapture.grab()) {
+      return false;
+    }
+  }
+
+  cv::Mat decoded;
+  if (!videoCapture.read(decoded) || decoded.empty()) {
+    return false;
+  }
+
+  if (decoderScaling) {
+    frame.working = decoded;
+    frame.fullSize = sourceSize;
+    return true;
+  }
+
+  frame.fullSize = decoded.size();
+  if (workingSize.empty() || workingSize == decoded.size()) {
+    frame.working = decoded;
+  } else {
+    cv::resize(decoded, frame.working, workingSize, 0, 0, cv::INTER_AREA);
+  }
+  if (keepFullResolution) {
+    frame.full = decoded;
+  }
+  return true;
+}
+
+/**
+ * @brief Map boxes found in the working frame back to source resolution.
+ * @param boxes Boxes in working frame coordinates.
+ * @param frame The frame the boxes were found in.
+ * @return A vector of cv::Rect in source resolution coordinates.
+ */
+std::vector<cv::Rect> DetectionClass::mapToFullResolution(
+    const std::vector<cv::Rect>& boxes, const VideoFrame& frame) {
+  if (frame.working.empty() || frame.fullSize == frame.working.size()) {
+    return boxes;
+  }
+  double scaleX =
+      static_cast<double>(frame.fullSize.width) / frame.working.cols;
+  double scaleY =
+      static_cast<double>(frame.fullSize.height) / frame.working.rows;
+  std::vector<cv::Rect> mapped;
+  mapped.reserve(boxes.size());
+  for (const auto& box : boxes) {
+    int x1 = static_cast<int>(std::round(box.x * scaleX));
+    int y1 = static_cast<int>(std::round(box.y * scaleY));
+    int x2 = static_cast<int>(std::round((box.x + box.width) * scaleX));
+    int y2 = static_cast<int>(std::round((box.y + box.height) * scaleY));
+    mapped.push_back(cv::Rect(x1, y1, x2 - x1, y2 - y1));
+  }
+  return mapped;
+}
+
 /**
  * @brief Detect faces in the current frame obtained from the video stream.
+ * When a prefilter is enabled and rejects the frame, the full resolution pass
+ * is skipped and no detections are returned.
  * @return A vector of cv::Rect representing the detected faces' bounding boxes.
  */
 std::vector<cv::Rect> DetectionClass::detectFaces(cv::Mat& frame) {
   // Process a frame from the video stream and perform face detection
   // Return a vector of cv::Rect representing detected faces
+  if (prefilterMode != PrefilterMode::kNone) {
+    framesScreened++;
+    if (!passesPrefilter(frame)) {
+      framesRejected++;
+      return std::vector<cv::Rect>();
+    }
+  }
+  return forwardPass(faceDetectionModel, frame, cv::Size(300, 300),
+                     confidenceThreshold);
+}
+
+/**
+ * @brief Detect faces in several images with a single forward pass. The SSD
+ * output of a batch is one table of detections whose first column holds the
+ * index of the image each row belongs to.
+ * @param frames Images to detect faces in.
+ * @param confidences Receives the confidence of every returned box.
+ * @return One vector of cv::Rect per image, in that image's coordinates.
+ */
+std::vector<std::vector<cv::Rect>> DetectionClass::detectFacesBatch(
+    const std::vector<cv::Mat>& frames,
+    std::vector<std::vector<float>>& confidences) {
+  std::vector<std::vector<cv::Rect>> detectedFaces(frames.size());
+  confidences.assign(frames.size(), std::vector<float>());
+  if (frames.empty()) {
+    return detectedFaces;
+  }
+
+  cv::Mat blob = cv::dnn::blobFromImages(frames, 1.0, cv::Size(300, 300),
+                                         cv::Scalar(104, 117, 123));
+  faceDetectionModel.setInput(blob);
+  cv::Mat detections = faceDetectionModel.forward();
+
+  cv::Mat detection_matrix(detections.size[2], detections.size[3], CV_32F,
+                           detections.ptr<float>());
+
+  for (int i = 0; i < detection_matrix.rows; i++) {
+    int image = static_cast<int>(detection_matrix.at<float>(i, 0));
+    float confidence = detection_matrix.at<float>(i, 2);
+    if (image < 0 || image >= static_cast<int>(frames.size()) ||
+        confidence <= confidenceThreshold) {
+      continue;
+    }
+    const cv::Mat& frame = frames[image];
+    int x1 = static_cast<int>(detection_matrix.at<float>(i, 3) * frame.cols);
+    int y1 = static_cast<int>(detection_matrix.at<float>(i, 4) * frame.rows);
+    int x2 = static_cast<int>(detection_matrix.at<float>(i, 5) * frame.cols);
+    int y2 = static_cast<int>(detection_matrix.at<float>(i, 6) * frame.rows);
+    detectedFaces[image].push_back(cv::Rect(x1, y1, x2 - x1, y2 - y1));
+    confidences[image].push_back(confidence);
+  }
+  return detectedFaces;
+}
+
+/**
+ * @brief Enables a cheap first detection stage.
+ * @param mode The first stage to use, kNone disables the prefilter.
+ * @param cascadePath Haar or LBP cascade file, only used by kCascade.
+ * @return True if the stage is ready, false if the cascade failed to load.
+ */
+bool DetectionClass::enablePrefilter(PrefilterMode mode,
+                                     const std::string& cascadePath) {
+  if (mode == PrefilterMode::kCascade &&
+      (cascadePath.empty() || !prefilterCascade.load(cascadePath))) {
+    prefilterMode = PrefilterMode::kNone;
+    return false;
+  }
+  prefilterMode = mode;
+  framesScreened = 0;
+  framesRejected = 0;
+  return true;
+}
+
+/**
+ * @brief Runs a face detection network once.
+ * @param net The network to run. A change of input size reshapes its layer
+ * buffers on the next forward().
+ * @param frame Image to detect faces in.
+ * @param inputSize Network input resolution.
+ * @param threshold Minimum confidence of a returned detection.
+ * @return A vector of cv::Rect in frame coordinates.
+ */
+std::vector<cv::Rect> DetectionClass::forwardPass(cv::dnn::Net& net,
+                                                  const cv::Mat& frame,
+                                                  const cv::Size& inputSize,
+                                                  float threshold) {
   std::vector<cv::Rect> detectedFaces;
 
   // Preprocess the frame and detect faces using the ResNet face detection model
-  cv::Mat blob = cv::dnn::blobFromImage(frame, 1.0, cv::Size(300, 300),
+  cv::Mat blob = cv::dnn::blobFromImage(frame, 1.0, inputSize,
                                         cv::Scalar(104, 117, 123));
-  faceDetectionModel.setInput(blob);
-  cv::Mat detections = faceDetectionModel.forward();
+  net.setInput(blob);
+  cv::Mat detections = net.forward();
 
   cv::Mat detection_matrix(detections.size[2], detections.size[3], CV_32F,
                            detections.ptr<float>());
 
   for (int i = 0; i < detection_matrix.rows; i++) {
     float confidence = detection_matrix.at<float>(i, 2);
-    if (confidence > confidenceThreshold) {
+    if (confidence > threshold) {
       // Get normalized coordinates from the detection output
       int x1 = static_cast<int>(detection_matrix.at<float>(i, 3) * frame.cols);
       int y1 = static_cast<int>(detection_matrix.at<float>(i, 4) * frame.rows);
@@ -84,8 +324,6 @@ std::vector<cv::Rect> DetectionClass::detectFaces(cv::Mat& frame) {
 
       cv::Rect faceRect(x1, y1, x2 - x1, y2 - y1);
 
-      // cv::rectangle(frame, faceRect, cv::Scalar(0, 255, 0),2, 4);
-
       // Store the detected face's bounding box
       detectedFaces.push_back(faceRect);
     }
@@ -93,3 +331,32 @@ std::vector<cv::Rect> DetectionClass::detectFaces(cv::Mat& frame) {
 
   return detectedFaces;
 }
+
+/**
+ * @brief Asks the prefilter whether the frame may contain a face. The low
+ * resolution pass reuses the loaded network at a 128x128 input, which costs
+ * roughly a fifth of the 300x300 pass. Switching sizes reshapes the layer
+ * buffers, which is cheaper than holding a second copy of the weights. The
+ * cascade runs on a grayscale copy scaled down to at most 320 pixels wide.
+ * @param frame Image to screen.
+ * @return True if the full SSD should run on the frame.
+ */
+bool DetectionClass::passesPrefilter(const cv::Mat& frame) {
+  if (prefilterMode == PrefilterMode::kLowResNet) {
+    return !forwardPass(faceDetectionModel, frame, prefilterSize,
+                        prefilterThreshold)
+                .empty();
+  }
+
+  cv::Mat gray;
+  cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+  if (gray.cols > 320) {
+    cv::resize(gray, gray, cv::Size(320, gray.rows * 320 / gray.cols), 0, 0,
+               cv::INTER_AREA);
+  }
+  cv::equalizeHist(gray, gray);
+  std::vector<cv::Rect> candidates;
+  prefilterCascade.detectMultiScale(gray, candidates, 1.2, 2, 0,
+                                    cv::Size(16, 16));
+  return !candidates.empty();
+}
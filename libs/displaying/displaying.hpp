@@ -0,0 +1,157 @@
+/**
+Copyright © 2023 <copyright holders>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/**
+ * @file displaying.hpp
+ * @author Lowell Lobo
+ * @author Mayank Deshpande
+ * @author Kautilya Chappidi
+ * @brief Class Definition for the DisplayClass
+ * @version 0.1
+ * @date 2023-11-08
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef DISPLAYING_HPP
+#define DISPLAYING_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * @class DisplayClass
+ * @brief A class for displaying object locations on a preview of the video
+ * stream without slowing down detection and tracking.
+ *
+ * The perception loop hands over a reference counted frame together with a
+ * snapshot of the tracks. A separate thread draws the overlay onto an
+ * optionally downscaled copy. Only the latest snapshot is kept, so when
+ * drawing falls behind preview frames are dropped and submit() never waits
+ * for the renderer. HighGUI must be driven from the main thread, so show()
+ * displays the latest drawn preview there.
+ */
+class DisplayClass {
+ public:
+  /**
+   * @brief Constructor for DisplayClass, starts the render thread.
+   * @param windowName Name of the preview window
+   * @param previewScale Scale of the preview relative to the frame, in (0, 1]
+   * @param onStart Called on the render thread before it draws anything, e.g.
+   * to pin it with ThreadPlacement
+   */
+  DisplayClass(const std::string& windowName, double previewScale,
+               std::function<void()> onStart = std::function<void()>());
+
+  /**
+   * @brief Destructor for DisplayClass, stops and joins the render thread
+   * and closes the window. Must run on the thread that calls show().
+   */
+  ~DisplayClass();
+
+  /**
+   * @brief Hands a frame and its tracks to the render thread. Replaces any
+   * snapshot that has not been drawn yet. The frame is shared, not copied, so
+   * the caller must not write into its pixels afterwards.
+   * @param frame The frame the tracks were found in
+   * @param tracks Obstacle IDs and boxes in frame coordinates
+   * @param carDistance Obstacle IDs and distances from the car
+   * @param trackSpace Resolution the boxes are given in, empty if they are in
+   * frame coordinates
+   */
+  void submit(const cv::Mat& frame, const std::map<int, cv::Rect>& tracks,
+              const std::map<int, std::tuple<double, double, double>>&
+                  carDistance,
+              const cv::Size& trackSpace = cv::Size());
+
+  /**
+   * @brief Shows the latest drawn preview, if there is a new one, and polls
+   * the keyboard. All HighGUI calls happen here, so this must be called from
+   * the main thread, once per iteration of the perception loop.
+   */
+  void show();
+
+  /**
+   * @brief Draws the overlay of a snapshot onto a preview image. Called by the
+   * render thread, public so the drawing can be used and tested on its own.
+   * @param frame The full resolution frame, left untouched
+   * @param tracks Obstacle IDs and boxes in frame coordinates
+   * @param carDistance Obstacle IDs and distances from the car
+   * @param trackSpace Resolution the boxes are given in, empty if they are in
+   * frame coordinates
+   * @return cv::Mat The preview with boxes and labels.
+   */
+  cv::Mat drawObjectLocations(
+      const cv::Mat& frame, const std::map<int, cv::Rect>& tracks,
+      const std::map<int, std::tuple<double, double, double>>& carDistance,
+      const cv::Size& trackSpace = cv::Size());
+
+  /**
+   * @brief Whether the operator pressed escape in the preview window.
+   * @return True once escape was pressed.
+   */
+  bool stopRequested() const;
+
+  std::atomic<long> framesRendered;  ///< Snapshots drawn.
+  std::atomic<long> framesDropped;   ///< Snapshots replaced before drawing.
+  std::size_t maxCachedLabels = 256;  ///< Bound of the label raster cache.
+
+ private:
+  /**
+   * @brief Body of the render thread.
+   */
+  void renderLoop();
+
+  /**
+   * @brief Returns the rasterised "ID: " prefix of a label, rendering it on a
+   * cache miss.
+   * @param id The obstacle ID
+   * @return const std::pair<cv::Mat, cv::Mat>& The label image and its mask.
+   */
+  const std::pair<cv::Mat, cv::Mat>& rasterizeLabel(int id);
+
+  std::string windowName;  ///< Name of the preview window.
+  double previewScale;     ///< Scale of the preview relative to the frame.
+  std::function<void()> onStart;  ///< Render thread start hook.
+
+  std::mutex snapshotMutex;  ///< Guards the pending snapshot.
+  std::condition_variable snapshotReady;
+  bool pending = false;  ///< A snapshot is waiting to be drawn.
+  bool stopping = false;  ///< The destructor asked the thread to exit.
+  cv::Mat pendingFrame;
+  std::map<int, cv::Rect> pendingTracks;
+  std::map<int, std::tuple<double, double, double>> pendingDistances;
+  cv::Size pendingTrackSpace;
+  cv::Mat drawnPreview;  ///< Latest preview not shown yet.
+  bool windowOpen = false;  ///< show() has opened the window.
+  std::atomic<bool> escapePressed;
+
+  /**
+   * @brief LRU cache of rasterised label prefixes by ID, most recently used
+   * first.
+   */
+  std::list<std::pair<int, std::pair<cv::Mat, cv::Mat>>> labelCache;
+  std::unordered_map<int, decltype(labelCache)::iterator> labelIndex;
+
+  std::thread renderThread;  ///< Started last, joined by the destructor.
+};
+
+#endif  // DISPLAYING_HPP
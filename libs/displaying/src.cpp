@@ -0,0 +1,262 @@
+/**
+Copyright © 2023 <copyright holders>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/**
+ * @file src.cpp
+ * @author Lowell Lobo
+ * @author Mayank Deshpande
+ * @author Kautilya Chappidi
+ * @brief Class Decleration for the DisplayClass
+ * @version 0.1
+ * @date 2023-11-08
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include "displaying.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+
+/**
+ * @brief Constructor, starts the render thread.
+ * @param windowName Name of the preview window
+ * @param previewScale Scale of the preview relative to the frame
+ * @param onStart Called on the render thread before it draws anything
+ */
+DisplayClass::DisplayClass(const std::string& windowName, double previewScale,
+                           std::function<void()> onStart)
+    : framesRendered(0),
+      framesDropped(0),
+      windowName(windowName),
+      previewScale(std::min(1.0, std::max(0.05, previewScale))),
+      onStart(std::move(onStart)),
+      escapePressed(false) {
+  renderThread = std::thread(&DisplayClass::renderLoop, this);
+}
+
+/**
+ * @brief Default Destructor, stops and joins the render thread and closes the
+ * window opened by show().
+ */
+DisplayClass::~DisplayClass() {
+  {
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    stopping = true;
+  }
+  snapshotReady.notify_one();
+  renderThread.join();
+  if (windowOpen) {
+    cv::destroyWindow(windowName);
+  }
+}
+
+/**
+ * @brief Hands a frame and its tracks to the render thread. The previous
+ * snapshot is overwritten if it was not drawn yet, so the caller only ever
+ * waits for the short copy of the track maps.
+ * @param frame The frame the tracks were found in
+ * @param tracks Obstacle IDs and boxes in frame coordinates
+ * @param carDistance Obstacle IDs and distances from the car
+ * @param trackSpace Resolution the boxes are given in
+ */
+void DisplayClass::submit(
+    const cv::Mat& frame, const std::map<int, cv::Rect>& tracks,
+    const std::map<int, std::tuple<double, double, double>>& carDistance,
+    const cv::Size& trackSpace) {
+  {
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    if (pending) {
+      framesDropped++;
+    }
+    pendingFrame = frame;
+    pendingTracks = tracks;
+    pendingDistances = carDistance;
+    pendingTrackSpace = trackSpace;
+    pending = true;
+  }
+  snapshotReady.notify_one();
+}
+
+/**
+ * @brief Shows the latest preview drawn by the render thread and polls the
+ * keyboard. A preview is shown at most once; when drawing falls behind the
+ * window keeps the previous one while the events are still pumped.
+ */
+void DisplayClass::show() {
+  cv::Mat preview;
+  {
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    preview = drawnPreview;
+    drawnPreview.release();
+  }
+  if (!preview.empty()) {
+    cv::imshow(windowName, preview);
+    windowOpen = true;
+  }
+  int escKey = 27;
+  if (windowOpen && cv::waitKey(1) == escKey) {
+    escapePressed = true;
+  }
+}
+
+/**
+ * @brief Draws object locations and additional information on a preview of
+ * the video frame. Boxes are scaled into the preview. The "ID: " part of a
+ * label is taken from the raster cache and blended in with its mask, the
+ * distances change from frame to frame and are drawn next to it.
+ * @param frame The full resolution frame, left untouched
+ * @param tracks Obstacle IDs and boxes in frame coordinates
+ * @param carDistance Obstacle IDs and distances from the car
+ * @param trackSpace Resolution the boxes are given in
+ * @return cv::Mat The preview with boxes and labels.
+ */
+cv::Mat DisplayClass::drawObjectLocations(
+    const cv::Mat& frame, const std::map<int, cv::Rect>& tracks,
+    const std::map<int, std::tuple<double, double, double>>& carDistance,
+    const cv::Size& trackSpace) {
+  cv::Mat preview;
+  if (previewScale < 1.0) {
+    cv::resize(frame, preview, cv::Size(), previewScale, previewScale,
+               cv::INTER_AREA);
+  } else {
+    preview = frame.clone();
+  }
+
+  cv::Scalar color(0, 105, 205);
+  int thickness = std::max(1, static_cast<int>(4 * previewScale));
+  int textThickness = std::max(1, static_cast<int>(2 * previewScale));
+  int baseline = 0;
+  cv::getTextSize("0", cv::FONT_HERSHEY_COMPLEX, previewScale, textThickness,
+                  &baseline);
+  char text[64];
+  double boxScaleX = previewScale, boxScaleY = previewScale;
+  if (!trackSpace.empty()) {
+    boxScaleX = static_cast<double>(preview.cols) / trackSpace.width;
+    boxScaleY = static_cast<double>(preview.rows) / trackSpace.height;
+  }
+  for (const auto& r : tracks) {
+    cv::Rect box(static_cast<int>(r.second.x * boxScaleX),
+                 static_cast<int>(r.second.y * boxScaleY),
+                 static_cast<int>(r.second.width * boxScaleX),
+                 static_cast<int>(r.second.height * boxScaleY));
+    cv::rectangle(preview, box, color, thickness);
+
+    auto distance = carDistance.find(r.first);
+    if (distance == carDistance.end()) {
+      continue;
+    }
+    const auto& label = rasterizeLabel(r.first);
+
+    // Place the label above the box, clipped to the preview
+    cv::Rect target(box.x, box.y - 5 - label.first.rows, label.first.cols,
+                    label.first.rows);
+    cv::Rect visible = target & cv::Rect(0, 0, preview.cols, preview.rows);
+    if (visible.empty()) {
+      continue;
+    }
+    cv::Rect source(visible.x - target.x, visible.y - target.y, visible.width,
+                    visible.height);
+    cv::Mat destination = preview(visible);
+    label.first(source).copyTo(destination, label.second(source));
+
+    std::snprintf(text, sizeof(text), "(%d, %d, %d)",
+                  static_cast<int>(std::get<0>(distance->second)),
+                  static_cast<int>(std::get<1>(distance->second)),
+                  static_cast<int>(std::get<2>(distance->second)));
+    cv::putText(preview, text,
+                cv::Point(target.x + label.first.cols,
+                          target.y + label.first.rows - baseline),
+                cv::FONT_HERSHEY_COMPLEX, previewScale, CV_RGB(255, 0, 0),
+                textThickness);
+  }
+  return preview;
+}
+
+/**
+ * @brief Whether the operator pressed escape in the preview window.
+ * @return True once escape was pressed.
+ */
+bool DisplayClass::stopRequested() const { return escapePressed.load(); }
+
+/**
+ * @brief Body of the render thread. Waits for a snapshot, draws it and leaves
+ * the preview for show(). No HighGUI call is made on this thread.
+ */
+void DisplayClass::renderLoop() {
+  if (onStart) {
+    onStart();
+  }
+  cv::Mat frame;
+  std::map<int, cv::Rect> tracks;
+  std::map<int, std::tuple<double, double, double>> distances;
+  cv::Size trackSpace;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(snapshotMutex);
+      snapshotReady.wait(lock, [this]() { return pending || stopping; });
+      if (stopping) {
+        break;
+      }
+      frame = pendingFrame;
+      pendingFrame.release();
+      tracks.swap(pendingTracks);
+      distances.swap(pendingDistances);
+      trackSpace = pendingTrackSpace;
+      pending = false;
+    }
+
+    cv::Mat preview = drawObjectLocations(frame, tracks, distances, trackSpace);
+    frame.release();
+    {
+      std::lock_guard<std::mutex> lock(snapshotMutex);
+      drawnPreview = preview;
+    }
+    framesRendered++;
+  }
+}
+
+/**
+ * @brief Returns the rasterised "ID: " prefix of a label. The prefix of an
+ * obstacle never changes, so it is rendered once into a small image and mask
+ * and reused until it falls out of the LRU cache.
+ * @param id The obstacle ID
+ * @return const std::pair<cv::Mat, cv::Mat>& The label image and its mask.
+ */
+const std::pair<cv::Mat, cv::Mat>& DisplayClass::rasterizeLabel(int id) {
+  auto cached = labelIndex.find(id);
+  if (cached != labelIndex.end()) {
+    labelCache.splice(labelCache.begin(), labelCache, cached->second);
+    return cached->second->second;
+  }
+
+  double fontScale = previewScale;
+  int thickness = std::max(1, static_cast<int>(2 * previewScale));
+  std::string text = std::to_string(id) + ": ";
+  int baseline = 0;
+  cv::Size size = cv::getTextSize(text, cv::FONT_HERSHEY_COMPLEX, fontScale,
+                                  thickness, &baseline);
+  cv::Mat mask(size.height + baseline, size.width, CV_8UC1, cv::Scalar(0));
+  cv::putText(mask, text, cv::Point(0, size.height), cv::FONT_HERSHEY_COMPLEX,
+              fontScale, cv::Scalar(255), thickness);
+  cv::Mat image(mask.rows, mask.cols, CV_8UC3, CV_RGB(255, 0, 0));
+
+  labelCache.emplace_front(id, std::make_pair(image, mask));
+  labelIndex[id] = labelCache.begin();
+  if (labelCache.size() > maxCachedLabels) {
+    labelIndex.erase(labelCache.back().first);
+    labelCache.pop_back();
+  }
+  return labelCache.front().second;
+}
@@ -0,0 +1,320 @@
+/**
+Copyright © 2023 <copyright holders>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/**
+ * @file src.cpp
+ * @author Lowell Lobo
+ * @author Mayank Deshpande
+ * @author Kautilya Chappidi
+ * @brief Class Decleration for the ThreadPlacement
+ * @version 0.1
+ * @date 2023-11-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include "threading.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <opencv2/core.hpp>
+#include <sstream>
+
+/**
+ * @brief Default constructor, records the affinity of the calling thread as
+ * the placement of roles that are not pinned.
+ */
+ThreadPlacement::ThreadPlacement() : dnnThreads(-1), capturePriority(0) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &set)) {
+        processCpus.push_back(cpu);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Default Destructor.
+ */
+ThreadPlacement::~ThreadPlacement() {}
+
+/**
+ * @brief Parses a single command line option. The cpu options accept either a
+ * cpu list or "nodeN", in which case the cores are looked up in sysfs.
+ *
+ * @param name Option name including the leading dashes
+ * @param value Option value
+ * @return True if the option was recognised and its value is valid.
+ */
+bool ThreadPlacement::parseOption(const std::string& name,
+                                  const std::string& value) {
+  if (name == "--dnn-threads") {
+    // 0 would switch OpenCV threading off, so a budget needs at least one
+    int threads = 0;
+    if (!parseCount(value, threads) || threads == 0) {
+      return false;
+    }
+    dnnThreads = threads;
+    return true;
+  }
+  if (name == "--capture-priority") {
+    return parseCount(value, capturePriority);
+  }
+
+  const std::map<std::string, ThreadRole> roles = {
+      {"--capture-cpus", ThreadRole::kCapture},
+      {"--inference-cpus", ThreadRole::kInference},
+      {"--output-cpus", ThreadRole::kOutput}};
+  auto role = roles.find(name);
+  if (role == roles.end()) {
+    return false;
+  }
+
+  RolePlacement placement;
+  if (value.compare(0, 4, "node") == 0) {
+    if (parseCount(value.substr(4), placement.numaNode)) {
+      placement.cpus = numaNodeCpus(placement.numaNode);
+    }
+  } else {
+    placement.cpus = parseCpuList(value);
+  }
+  if (placement.cpus.empty()) {
+    return false;
+  }
+  placements[role->second] = placement;
+  return true;
+}
+
+/**
+ * @brief Applies the DNN thread budget. When no budget is given but the
+ * inference thread is pinned, OpenCV is limited to the pinned cores so that
+ * its worker pool does not oversubscribe the machine. OpenCV creates its
+ * workers on the first parallel call and they inherit the affinity of the
+ * thread making it, so an empty parallel loop starts them here rather than in
+ * whichever thread resizes a frame first.
+ */
+void ThreadPlacement::applyDnnThreads() {
+  int threads = dnnThreads;
+  auto inference = placements.find(ThreadRole::kInference);
+  if (threads < 0 && inference != placements.end()) {
+    threads = static_cast<int>(inference->second.cpus.size());
+  }
+  if (threads >= 0) {
+    cv::setNumThreads(threads);
+  }
+  cv::parallel_for_(cv::Range(0, cv::getNumThreads()),
+                    [](const cv::Range&) {});
+}
+
+/**
+ * @brief Pins the calling thread to the cores of its role, or back to the
+ * process affinity if the role has none. The affinity is read back from the
+ * kernel so that the report shows what was obtained rather than what was
+ * requested.
+ *
+ * @param role Pipeline stage the calling thread runs
+ * @return True if the placement was applied or none is configured.
+ */
+bool ThreadPlacement::pinCurrentThread(ThreadRole role) {
+  bool ok = true;
+  auto placement = placements.find(role);
+  const std::vector<int>& cpus =
+      placement != placements.end() ? placement->second.cpus : processCpus;
+  if (!cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+      if (cpu >= 0 && cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, &set);
+      }
+    }
+    ok = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+  }
+
+  cpu_set_t effective;
+  CPU_ZERO(&effective);
+  std::ostringstream note;
+  if (pthread_getaffinity_np(pthread_self(), sizeof(effective), &effective) ==
+      0) {
+    note << CPU_COUNT(&effective) << " cores [";
+    bool first = true;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &effective)) {
+        note << (first ? "" : ",") << cpu;
+        first = false;
+      }
+    }
+    note << "]";
+  }
+  if (!ok) {
+    note << " (pinning refused)";
+  }
+
+  std::lock_guard<std::mutex> lock(appliedMutex);
+  applied[role] = note.str();
+  return ok;
+}
+
+/**
+ * @brief Switches the calling thread to SCHED_FIFO. This normally requires
+ * CAP_SYS_NICE or a suitable RLIMIT_RTPRIO; a refusal is reported but not
+ * fatal.
+ *
+ * @return True if no priority is configured or it was applied.
+ */
+bool ThreadPlacement::applyCapturePriority() {
+  if (capturePriority <= 0) {
+    return true;
+  }
+  sched_param param{};
+  param.sched_priority = std::min(capturePriority,
+                                  sched_get_priority_max(SCHED_FIFO));
+  bool ok = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+
+  std::lock_guard<std::mutex> lock(appliedMutex);
+  applied[ThreadRole::kCapture] +=
+      ok ? " SCHED_FIFO " + std::to_string(param.sched_priority)
+         : " (real-time priority refused)";
+  return ok;
+}
+
+/**
+ * @brief Builds the startup topology report.
+ *
+ * @return std::string The multi-line report.
+ */
+std::string ThreadPlacement::topologyReport() {
+  std::ostringstream report;
+  report << "Thread topology" << std::endl;
+  report << "  online cores:     " << sysconf(_SC_NPROCESSORS_ONLN)
+         << std::endl;
+  int nodes = 0;
+  while (!numaNodeCpus(nodes).empty()) {
+    nodes++;
+  }
+  report << "  NUMA nodes:       " << nodes << std::endl;
+  report << "  OpenCV threads:   " << cv::getNumThreads() << std::endl;
+
+  std::lock_guard<std::mutex> lock(appliedMutex);
+  for (ThreadRole role :
+       {ThreadRole::kCapture, ThreadRole::kInference, ThreadRole::kOutput}) {
+    std::string name = roleName(role) + ":";
+    report << "  " << name << std::string(18 - name.size(), ' ');
+    auto placement = placements.find(role);
+    if (placement == placements.end()) {
+      report << "unpinned";
+    } else if (placement->second.numaNode >= 0) {
+      report << "node " << placement->second.numaNode;
+    } else {
+      report << placement->second.cpus.size() << " cores requested";
+    }
+    auto note = applied.find(role);
+    report << ", running on "
+           << (note == applied.end() ? "no thread" : note->second)
+           << std::endl;
+  }
+  return report.str();
+}
+
+/**
+ * @brief Parses a whole string as a non-negative integer. Unlike atoi, a
+ * value such as "abc", "4x" or one that overflows int is refused.
+ *
+ * @param text The string
+ * @param value Receives the integer, untouched on failure
+ * @return True if the string is a non-negative integer and nothing else.
+ */
+bool ThreadPlacement::parseCount(const std::string& text, int& value) {
+  char* end = nullptr;
+  errno = 0;
+  long parsed = std::strtol(text.c_str(), &end, 10);
+  if (text.empty() || *end != '\0' || errno == ERANGE || parsed < 0 ||
+      parsed > INT_MAX) {
+    return false;
+  }
+  value = static_cast<int>(parsed);
+  return true;
+}
+
+/**
+ * @brief Parses a Linux style cpu list.
+ *
+ * @param list The cpu list, e.g. "0-3,6"
+ * @return std::vector<int> The cores in the list, empty if it is malformed.
+ */
+std::vector<int> ThreadPlacement::parseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream stream(list);
+  std::string range;
+  while (std::getline(stream, range, ',')) {
+    int first = 0, last = 0;
+    char dash = 0;
+    std::istringstream item(range);
+    if (!(item >> first)) {
+      return std::vector<int>();
+    }
+    last = first;
+    if (item >> dash && (dash != '-' || !(item >> last))) {
+      return std::vector<int>();
+    }
+    if (first < 0 || last < first) {
+      return std::vector<int>();
+    }
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+/**
+ * @brief Reads the cores belonging to a NUMA node from sysfs.
+ *
+ * @param node NUMA node index
+ * @return std::vector<int> The cores of the node, empty if it does not exist.
+ */
+std::vector<int> ThreadPlacement::numaNodeCpus(int node) {
+  std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) +
+                     "/cpulist");
+  std::string list;
+  if (node < 0 || !std::getline(file, list)) {
+    return std::vector<int>();
+  }
+  return parseCpuList(list);
+}
+
+/**
+ * @brief Returns the printable name of a pipeline stage.
+ *
+ * @param role Pipeline stage
+ * @return std::string The stage name.
+ */
+std::string ThreadPlacement::roleName(ThreadRole role) {
+  switch (role) {
+    case ThreadRole::kCapture:
+      return "capture";
+    case ThreadRole::kInference:
+      return "inference";
+    case ThreadRole::kOutput:
+      return "output";
+  }
+  return "unknown";
+}
@@ -0,0 +1,176 @@
+/**
+Copyright © 2023 <copyright holders>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/**
+ * @file threading.hpp
+ * @author Lowell Lobo
+ * @author Mayank Deshpande
+ * @author Kautilya Chappidi
+ * @brief Class Definition for the ThreadPlacement
+ * @version 0.1
+ * @date 2023-11-02
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef THREADING_HPP
+#define THREADING_HPP
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The pipeline stages whose threads can be placed on cores.
+ *
+ */
+enum class ThreadRole { kCapture, kInference, kOutput };
+
+/**
+ * @brief Where a single pipeline stage is allowed to run. An empty cpu list
+ * leaves the thread unpinned.
+ *
+ */
+struct RolePlacement {
+  std::vector<int> cpus;  ///< Cores the thread may run on.
+  int numaNode = -1;      ///< NUMA node the cores were taken from, or -1.
+};
+
+/**
+ * @class ThreadPlacement
+ * @brief A class holding the runtime thread configuration of the pipeline.
+ *
+ * The class budgets the OpenCV DNN thread pool, pins each pipeline thread to
+ * a set of cores (given directly or as a NUMA node), raises the capture thread
+ * to real-time priority and reports the effective topology at startup.
+ */
+class ThreadPlacement {
+ public:
+  /**
+   * @brief Number of threads OpenCV may use for DNN inference. A negative
+   * value leaves the OpenCV default; when unset and the inference thread is
+   * pinned, the budget defaults to the number of inference cores.
+   *
+   */
+  int dnnThreads;
+  /**
+   * @brief SCHED_FIFO priority for the capture thread, 0 keeps the default
+   * scheduling policy.
+   *
+   */
+  int capturePriority;
+  /**
+   * @brief Core placement of every configured pipeline stage.
+   *
+   */
+  std::map<ThreadRole, RolePlacement> placements;
+
+  /**
+   * @brief Constructor for ThreadPlacement, nothing is pinned by default.
+   */
+  ThreadPlacement();
+
+  /**
+   * @brief Destructor for ThreadPlacement.
+   */
+  ~ThreadPlacement();
+
+  /**
+   * @brief Parses a single command line option such as "--capture-cpus".
+   *
+   * Recognised options are --dnn-threads N (at least 1), --capture-priority P
+   * and --{capture,inference,output}-cpus LIST where LIST is either a cpu list
+   * ("0-3,6") or a NUMA node ("node1"). Tracking runs on the inference thread
+   * and has no option of its own.
+   *
+   * @param name Option name including the leading dashes
+   * @param value Option value
+   * @return True if the option was recognised and its value is valid.
+   */
+  bool parseOption(const std::string& name, const std::string& value);
+
+  /**
+   * @brief Applies the DNN thread budget through cv::setNumThreads and starts
+   * the OpenCV worker pool. Must be called from the inference thread after it
+   * is pinned and before other threads run OpenCV code, so that the pool
+   * inherits the inference affinity.
+   */
+  void applyDnnThreads();
+
+  /**
+   * @brief Pins the calling thread to the cores configured for the role and
+   * records the effective affinity for the topology report. A role without a
+   * placement gets the affinity the process had when this object was built,
+   * so it does not inherit the cores of the thread that started it.
+   *
+   * @param role Pipeline stage the calling thread runs
+   * @return True if the thread is unpinned by configuration or the affinity
+   * was applied, false if the kernel refused it.
+   */
+  bool pinCurrentThread(ThreadRole role);
+
+  /**
+   * @brief Switches the calling thread to SCHED_FIFO with capturePriority.
+   *
+   * @return True if no priority is configured or it was applied, false if the
+   * process lacks the privilege to change it.
+   */
+  bool applyCapturePriority();
+
+  /**
+   * @brief Builds a human readable report of the machine topology, the
+   * configured placement and the placement each thread actually obtained.
+   *
+   * @return std::string The multi-line report.
+   */
+  std::string topologyReport();
+
+  /**
+   * @brief Parses a whole string as a non-negative integer.
+   *
+   * @param text The string
+   * @param value Receives the integer, untouched on failure
+   * @return True if the string is a non-negative integer and nothing else.
+   */
+  static bool parseCount(const std::string& text, int& value);
+
+  /**
+   * @brief Parses a Linux style cpu list such as "0-3,6".
+   *
+   * @param list The cpu list
+   * @return std::vector<int> The cores in the list, empty if it is malformed.
+   */
+  static std::vector<int> parseCpuList(const std::string& list);
+
+  /**
+   * @brief Reads the cores belonging to a NUMA node from sysfs.
+   *
+   * @param node NUMA node index
+   * @return std::vector<int> The cores of the node, empty if it does not exist.
+   */
+  static std::vector<int> numaNodeCpus(int node);
+
+  /**
+   * @brief Returns the printable name of a pipeline stage.
+   *
+   * @param role Pipeline stage
+   * @return std::string The stage name.
+   */
+  static std::string roleName(ThreadRole role);
+
+ private:
+  std::vector<int> processCpus;  ///< Affinity when the object was built.
+  std::mutex appliedMutex;  ///< Guards applied, threads report concurrently.
+  std::map<ThreadRole, std::string> applied;  ///< Effective placement notes.
+};
+
+#endif  // THREADING_HPP
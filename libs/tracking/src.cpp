@@ -23,19 +23,32 @@ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR I
  */
 #include "tracking.hpp"
 
+/**
+ * @brief Camera mounting of the core, from the constructor arguments.
+ */
+static CameraMount cameraMount(double x, double y, double z, double th,
+                               double tv) {
+  CameraMount mount;
+  mount.xOffset = x;
+  mount.yOffset = y;
+  mount.zOffset = z;
+  mount.horizontalFOI = th;
+  mount.verticalFOI = tv;
+  return mount;
+}
+
 /**
  * @brief Default constructor.
  */
-TrackingClass::TrackingClass(const std::string& detectModelPath,
-                             const std::string& detectConfigPath, double x,
-                             double y, double z, double th, double tv)
+TrackingClass::TrackingClass(double x, double y, double z, double th,
+                             double tv)
     : xOffset(x),
       yOffset(y),
       zOffset(z),
       horizontalFOI(th),
       verticalFOI(tv),
       count(0),
-      image(detectModelPath, detectConfigPath) {}
+      core(cameraMount(x, y, z, th, tv)) {}
 
 /**
  * @brief Default Destructor.
@@ -46,104 +59,261 @@ TrackingClass::~TrackingClass() {}
  * @brief Finds the depth of an object in the scene.
  * The depth is found analytically by comparing detection height values and
  * z distances. A series of linear functions are then built using the
- * tested cases to predict the z distance.
+ * tested cases to predict the z distance, see PiecewiseDepthModel.
  *
  * @param id Variable used to access the obstacles in the obstacleMap
  * @return double The depth of the object in meters.
  */
 double TrackingClass::findDepth(int id) {
-  double height = obstacleMapVector[id].height;
-  if (height < 108) {
-    return ((-73) * (height - 108) / (56)) + 46;
-  } else if (height < 251) {
-    return ((-25) * (height - 251) / (143)) + 21;
-  } else if (height < 405) {
-    return ((-12) * (height - 405) / (154)) + 9;
-  } else if (height < 445) {
-    return ((-9) * (height - 405) / (35)) + 9;
-  } else {
-    return 0.0;
-  }
+  auto track = obstacleMapVector.find(id);
+  return PiecewiseDepthModel::depth(
+      track != obstacleMapVector.end() ? track->second.height : 0);
 }
 
 /**
- * @brief Assigns IDs to objects in the scene.
- * 1 - When the obstacleMap is empty the method adds new detections into the
- * Map. 2 - When the number of detected obstacles and current obstacles are the
- * same, the function will find the minimum Euclidean distance value and
- * reassign the ID to the nearest detection. 3 - When the number of detected
- * obstacles are greater than the current obstacles, all current obstacles will
- * be mapped and then the remaining detections will be assigned a new ID. 4 -
- * When the number of detected obstacles are lesser than the current obstacles,
- * all current obstacles will be mapped and only obstacles near the edge of
- * frame will be deleted. If the obstacle is in the center, the algorithm
- * assumes that the detection failed because of low accuracy and when the
- * obstacle reappears the ID will be reassigned, in the mean time the obstacle
- * bounding box will be displayed at the last detected location.
+ * @brief Assigns IDs to objects in the scene, following the rules of
+ * VgaTrackerCore.
+ * 1 - Detections and tracks are paired by the distance between their
+ * centres, closest pairs first, and pairs further apart than 50 pixels are
+ * never matched. 2 - Detections left over are assigned new IDs, which are
+ * never reused. 3 - A track left over near the edge of the frame is deleted.
+ * 4 - A track left over in the centre is kept, the algorithm assumes that the
+ * detection failed because of low accuracy and when the obstacle reappears
+ * the ID will be reassigned, in the mean time the obstacle bounding box will
+ * be displayed at the last detected location. After 30 frames without a
+ * match it is deleted.
  *
  * @param detections A vector containing all the detected faces in image frame
  * @return std::map<int, cv::Rect> A map of object IDs to object names.
  */
 std::map<int, cv::Rect> TrackingClass::assignIDAndTrack(
-    std::vector<cv::Rect>& detections) {
-  int len = detections.size();
-  int lenObjMap = obstacleMapVector.size();
-
-  if (detections.size() > 0) {
-    for (const auto& r : obstacleMapVector) {
-      std::vector<double> distances(detections.size());
-      std::map<double, cv::Rect> distMap;
-      if (detections.size() > 0) {
-        for (int i = 0; i < detections.size(); i++) {
-          distances.push_back(pow((detections[i].x - r.second.x), 2) +
-                              pow((detections[i].x - r.second.x), 2));
-          distMap[distances[i]] = detections[i];
-        }
-      } else {
-        distances.push_back(-100);
-      }
+    const std::vector<cv::Rect>& detections) {
+  updateTracks(detections);
+  return obstacleMapVector;
+}
 
-      int minVal = *std::min_element(distances.begin(), distances.end());
-
-      if ((len < lenObjMap)) {
-        if (((r.second.x < 10) || (r.second.y < 10) ||
-             (r.second.x + r.second.width > 640 - 10) ||
-             (r.second.y + r.second.height > 480 - 10)) &&
-            (minVal < 0)) {
-          obstacleMapVector.erase(r.first);
-        } else if (((r.second.x < 10) || (r.second.y < 10) ||
-                    (r.second.x + r.second.width > 640 - 10) ||
-                    (r.second.y + r.second.height > 480 - 10)) &&
-                   (minVal > 2500)) {
-          obstacleMapVector.erase(r.first);
-        } else if ((minVal < 0) || (minVal > 2500)) {
-          continue;
-        } else if (detections.size() > 0) {
-          obstacleMapVector[r.first] = distMap[minVal];
-          detections.erase(
-              std::find(detections.begin(), detections.end(), distMap[minVal]));
-        }
-      } else {
-        obstacleMapVector[r.first] = distMap[minVal];
-        detections.erase(
-            std::find(detections.begin(), detections.end(), distMap[minVal]));
-      }
+/**
+ * @brief Runs the association and converts its outcome into track events,
+ * without appearance information.
+ *
+ * @param detections A vector containing all the detected faces in image frame
+ * @return const std::vector<TrackEvent>& The events of this frame.
+ */
+const std::vector<TrackEvent>& TrackingClass::updateTracks(
+    const std::vector<cv::Rect>& detections) {
+  return updateTracks(detections, cv::Mat());
+}
+
+/**
+ * @brief Runs the association of the core and converts its outcome into
+ * track events by comparing the tracks before and after. A track that is
+ * kept but not matched coasts at its last box; when it is matched again it
+ * is reported as re-acquired rather than updated. When a frame is given, new
+ * tracks are first compared against the gallery of lost tracks and take over
+ * a matching old ID.
+ *
+ * @param detections A vector containing all the detected faces in image frame
+ * @param frame The frame the detections were found in, may be empty
+ * @param trackSpace Resolution the detections are given in
+ * @return const std::vector<TrackEvent>& The events of this frame.
+ */
+const std::vector<TrackEvent>& TrackingClass::updateTracks(
+    const std::vector<cv::Rect>& detections, const cv::Mat& frame,
+    const cv::Size& trackSpace) {
+  frameEvents.clear();
+  reidentifiedIds.clear();
+  createdIds.clear();
+  lostTracks.clear();
+  previousTracks.swap(obstacleMapVector);
+  previousMissed.swap(missedFrames);
+
+  int lastId = core.count;
+  core.update(detections);
+  mirrorCore();
+
+  for (const auto& previous : previousTracks) {
+    if (obstacleMapVector.find(previous.first) == obstacleMapVector.end()) {
+      lostTracks.insert(previous);
     }
+  }
+
+  gallery.age();
+  for (const auto& lost : lostTracks) {
+    auto descriptor = appearance.find(lost.first);
+    if (descriptor != appearance.end()) {
+      gallery.remember(lost.first, descriptor->second);
+      appearance.erase(descriptor);
+    }
+  }
 
-    if (len > lenObjMap) {
-      for (int i = 0; i < len - obstacleMapVector.size(); i++) {
-        obstacleMapVector[++count] = detections[i];
+  // The core numbered the new tracks after lastId. Number them again, so
+  // that a new track only gets a fresh ID when the gallery has no old one
+  int nextId = lastId;
+  const auto& tracks = core.tracks();
+  for (std::size_t i = 0; i < tracks.size(); i++) {
+    if (tracks[i].id <= lastId) {
+      if (!frame.empty() && tracks[i].missed == 0) {
+        appearance[tracks[i].id] =
+            AppearanceGallery::describe(frame, tracks[i].box, trackSpace);
       }
+      continue;
+    }
+    cv::Rect box = tracks[i].box;
+    obstacleMapVector.erase(tracks[i].id);
+    cv::Mat descriptor;
+    int previousId = -1;
+    if (!frame.empty()) {
+      descriptor = AppearanceGallery::describe(frame, box, trackSpace);
+      previousId = gallery.recall(descriptor, obstacleMapVector);
+    }
+    int id = previousId;
+    if (previousId < 0) {
+      id = ++nextId;
+      createdIds.push_back(id);
+    } else {
+      reidentifiedIds.push_back(id);
+    }
+    core.relabel(i, id);
+    obstacleMapVector[id] = box;
+    if (!descriptor.empty()) {
+      appearance[id] = descriptor;
+    }
+  }
+  core.count = nextId;
+  count = nextId;
+
+  for (const auto& lost : lostTracks) {
+    publish({TrackEvent::kLost, lost.first, lost.second, 0});
+  }
+
+  for (int id : reidentifiedIds) {
+    publish({TrackEvent::kReacquired, id, obstacleMapVector[id], 0});
+  }
+
+  for (const auto& r : obstacleMapVector) {
+    auto previous = previousTracks.find(r.first);
+    if (previous == previousTracks.end() ||
+        missedFrames.find(r.first) != missedFrames.end()) {
+      continue;
+    }
+
+    if (previousMissed.find(r.first) != previousMissed.end()) {
+      publish({TrackEvent::kReacquired, r.first, r.second, 0});
+      continue;
+    }
+
+    int changed = 0;
+    if (r.second.x != previous->second.x || r.second.y != previous->second.y) {
+      changed |= TrackEvent::kPosition;
+    }
+    if (r.second.width != previous->second.width ||
+        r.second.height != previous->second.height) {
+      changed |= TrackEvent::kSize;
+    }
+    if (changed != 0) {
+      publish({TrackEvent::kUpdated, r.first, r.second, changed});
     }
+  }
+
+  for (int id : createdIds) {
+    publish({TrackEvent::kCreated, id, obstacleMapVector[id], 0});
+  }
+
+  return frameEvents;
+}
 
-    if (obstacleMapVector.size() > 0) {
-      return obstacleMapVector;
+/**
+ * @brief Copies the core tracks into obstacleMapVector and missedFrames, and
+ * the core counter into count.
+ */
+void TrackingClass::mirrorCore() {
+  obstacleMapVector.clear();
+  missedFrames.clear();
+  for (const auto& track : core.tracks()) {
+    obstacleMapVector[track.id] = track.box;
+    if (track.missed > 0) {
+      missedFrames[track.id] = track.missed;
     }
+  }
+  count = core.count;
+}
+
+/**
+ * @brief Registers a callback that is invoked for every track event.
+ *
+ * @param callback Function called synchronously from updateTracks()
+ */
+void TrackingClass::subscribe(
+    std::function<void(const TrackEvent&)> callback) {
+  subscribers.push_back(std::move(callback));
+}
+
+/**
+ * @brief Returns and clears all queued track events.
+ *
+ * @return std::vector<TrackEvent> The queued events in emission order.
+ */
+std::vector<TrackEvent> TrackingClass::drainEvents() {
+  std::vector<TrackEvent> events(eventQueue.begin(), eventQueue.end());
+  eventQueue.clear();
+  return events;
+}
+
+/**
+ * @brief Copies the tracks, the ID counter and the coasting state.
+ *
+ * @param state Receives the state, its storage is reused
+ */
+void TrackingClass::snapshot(TrackerState& state) const {
+  state.count = count;
+  state.tracks = obstacleMapVector;
+  state.missedFrames = missedFrames;
+}
 
-    return std::map<int, cv::Rect>();
-  } else {
-    count = 0;
-    return std::map<int, cv::Rect>();
+/**
+ * @brief Replaces the tracker state. Everything derived from frames before
+ * the restart is dropped, since it cannot be matched against the new stream.
+ *
+ * @param state The state to resume from
+ */
+void TrackingClass::restore(const TrackerState& state) {
+  // The counter never falls behind a restored ID, even if the state is
+  // inconsistent, so a new obstacle cannot take the ID of a restored one
+  int lastId = state.count;
+  std::vector<VgaTrackerCore::Track> tracks;
+  for (const auto& track : state.tracks) {
+    auto missed = state.missedFrames.find(track.first);
+    tracks.push_back({track.first, track.second, track.second, {},
+                      missed != state.missedFrames.end() ? missed->second : 0});
+    lastId = std::max(lastId, track.first);
+  }
+  core.restore(lastId, tracks);
+  mirrorCore();
+  previousTracks.clear();
+  previousMissed.clear();
+  createdIds.clear();
+  lostTracks.clear();
+  appearance.clear();
+  reidentifiedIds.clear();
+  frameEvents.clear();
+  eventQueue.clear();
+  gallery.clear();
+}
+
+/**
+ * @brief Passes an event to the subscribers, the event queue and the list of
+ * events of the current frame.
+ *
+ * @param event The event to publish
+ */
+void TrackingClass::publish(const TrackEvent& event) {
+  frameEvents.push_back(event);
+  for (const auto& callback : subscribers) {
+    callback(event);
+  }
+  eventQueue.push_back(event);
+  while (eventQueue.size() > maxQueuedEvents) {
+    eventQueue.pop_front();
   }
 }
 
@@ -174,7 +344,8 @@ std::map<int, std::tuple<double, double, double>> TrackingClass::distFromCamera(
  * Converts the Camera reference distance into Car reference distance, using
  * geometry. The method takes into account prototype configurations, such that
  * the camera not being placed at the origin of car reference and field of view
- * values of different cameras.
+ * values of different cameras. The projection is VgaTrackerCore::toCar(), so
+ * both give the same car distance for a track.
  *
  * @param input A map with containing the object ID, and tuple containing
  * distance in meters
@@ -187,19 +358,8 @@ std::map<int, std::tuple<double, double, double>> TrackingClass::distFromCamera(
 std::map<int, std::tuple<double, double, double>> TrackingClass::distFromCar(
     std::map<int, std::tuple<double, double, double>>& input) {
   std::map<int, std::tuple<double, double, double>> distances;
-
   for (const auto& r : input) {
-    double x, y;
-    double z = std::get<2>(input[r.first]);
-    x = 2 * z * tan(horizontalFOI / 2) * std::get<0>(input[r.first]) /
-        480;  // width
-    y = 2 * z * tan(verticalFOI / 2) * std::get<1>(input[r.first]) /
-        640;  // height
-    double xDist = x + xOffset;
-    double yDist = z + yOffset;
-    double zDist = -y + zOffset;
-    distances[r.first] = std::make_tuple(xDist, yDist, zDist);
-        // add each offset to each coord from class declar var
+    distances[r.first] = core.toCar(r.second);
   }
   return distances;
 }
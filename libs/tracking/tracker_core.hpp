@@ -0,0 +1,333 @@
+/**
+Copyright © 2023 <copyright holders>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/**
+ * @file tracker_core.hpp
+ * @author Lowell Lobo
+ * @author Mayank Deshpande
+ * @author Kautilya Chappidi
+ * @brief Class Definition for the policy based TrackerCore
+ * @version 0.1
+ * @date 2023-11-15
+ *
+ * @copyright Copyright (c) 2023
+ */
+
+#ifndef TRACKER_CORE_HPP
+#define TRACKER_CORE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/core.hpp>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Association metric: squared distance between box centroids.
+ * A detection further than MaxDistanceSquared from a track never matches it.
+ *
+ */
+template <int MaxDistanceSquared>
+struct CentroidDistanceMetric {
+  static constexpr double kMaxCost = MaxDistanceSquared;
+
+  static inline double cost(const cv::Rect& track, const cv::Rect& detection) {
+    double dx = (2 * detection.x + detection.width) -
+                (2 * track.x + track.width);
+    double dy = (2 * detection.y + detection.height) -
+                (2 * track.y + track.height);
+    return (dx * dx + dy * dy) / 4;
+  }
+};
+
+/**
+ * @brief Motion model that keeps a track at its last detected box.
+ *
+ */
+struct HoldMotionModel {
+  struct State {};
+
+  static inline cv::Rect predict(const cv::Rect& box, const State&, int) {
+    return box;
+  }
+  static inline void correct(State&, const cv::Rect&, const cv::Rect&, int) {}
+};
+
+/**
+ * @brief Motion model that extrapolates the last detected box by its
+ * exponentially smoothed per-frame displacement, which helps association of
+ * fast moving obstacles.
+ *
+ * predict() and correct() take the number of frames since the box was last
+ * detected, so coasting tracks keep moving and the displacement measured
+ * after a gap is spread over the frames it covers.
+ */
+struct ConstantVelocityMotionModel {
+  struct State {
+    double vx = 0, vy = 0;  ///< Smoothed displacement in pixels per frame.
+  };
+
+  static inline cv::Rect predict(const cv::Rect& box, const State& state,
+                                 int frames) {
+    return cv::Rect(box.x + static_cast<int>(std::lround(frames * state.vx)),
+                    box.y + static_cast<int>(std::lround(frames * state.vy)),
+                    box.width, box.height);
+  }
+  static inline void correct(State& state, const cv::Rect& lastDetected,
+                             const cv::Rect& measured, int frames) {
+    state.vx = 0.5 * state.vx + 0.5 * (measured.x - lastDetected.x) / frames;
+    state.vy = 0.5 * state.vy + 0.5 * (measured.y - lastDetected.y) / frames;
+  }
+};
+
+/**
+ * @brief Depth model fitted to measured box heights of the 640x480 camera,
+ * the same piecewise linear model as TrackingClass::findDepth().
+ *
+ */
+struct PiecewiseDepthModel {
+  static inline double depth(double height) {
+    if (height < 108) {
+      return ((-73) * (height - 108) / (56)) + 46;
+    } else if (height < 251) {
+      return ((-25) * (height - 251) / (143)) + 21;
+    } else if (height < 405) {
+      return ((-12) * (height - 405) / (154)) + 9;
+    } else if (height < 445) {
+      return ((-9) * (height - 405) / (35)) + 9;
+    } else {
+      return 0.0;
+    }
+  }
+};
+
+/**
+ * @brief Frame geometry: resolution and the border band in which unmatched
+ * tracks are treated as having left the frame.
+ *
+ */
+template <int Width, int Height, int Border>
+struct FrameGeometry {
+  static constexpr int kWidth = Width;
+  static constexpr int kHeight = Height;
+  static constexpr int kBorder = Border;
+
+  static inline bool atBorder(const cv::Rect& box) {
+    return box.x < Border || box.y < Border ||
+           box.x + box.width > Width - Border ||
+           box.y + box.height > Height - Border;
+  }
+};
+
+/**
+ * @brief Mounting of the camera on the car, known only at runtime.
+ *
+ */
+struct CameraMount {
+  double xOffset = 0, yOffset = 0, zOffset = 0;  ///< Camera to car offsets.
+  double horizontalFOI = 1.57, verticalFOI = 0.7;  ///< Field of view.
+};
+
+/**
+ * @class TrackerCore
+ * @brief A tracker parameterised at compile time by its association metric,
+ * motion model, depth model and frame geometry.
+ *
+ * The core only consumes boxes, so it runs on any detection source. All
+ * policy calls are static and inline, and every threshold is a compile time
+ * constant, so a fixed configuration compiles to a loop without virtual or
+ * runtime dispatch. Tracks are kept in a vector and the association buffers
+ * are reused from frame to frame.
+ *
+ * The detections closest to the box predicted by Motion are matched first,
+ * unmatched detections become new tracks, unmatched tracks at the frame
+ * border are dropped and unmatched tracks inside the frame coast for at most
+ * MaxMissedFrames frames. TrackingClass is a facade over VgaTrackerCore.
+ */
+template <class Metric, class Motion, class Depth, class Geometry,
+          int MaxMissedFrames = 30>
+class TrackerCore {
+ public:
+  /**
+   * @brief A tracked obstacle.
+   *
+   */
+  struct Track {
+    int id;                        ///< Unique obstacle ID.
+    cv::Rect box;                  ///< Last detected box.
+    cv::Rect predicted;            ///< Expected box in the current frame.
+    typename Motion::State motion;  ///< Motion model state.
+    int missed;                    ///< Consecutive frames without a match.
+  };
+
+  /**
+   * @brief Constructor for TrackerCore.
+   * @param mount Camera mounting used by carDistance()
+   */
+  explicit TrackerCore(const CameraMount& mount = CameraMount())
+      : count(0),
+        mount(mount),
+        xScale(2 * std::tan(mount.horizontalFOI / 2) / Geometry::kWidth),
+        yScale(2 * std::tan(mount.verticalFOI / 2) / Geometry::kHeight) {}
+
+  /**
+   * @brief Associates one frame of detections with the tracks. Matching uses
+   * the predicted box, the motion model is corrected against the last
+   * detected box.
+   * @param detections Boxes in Geometry coordinates
+   */
+  void update(const std::vector<cv::Rect>& detections) {
+    pairs.clear();
+    for (std::size_t t = 0; t < trackList.size(); t++) {
+      Track& track = trackList[t];
+      track.predicted =
+          Motion::predict(track.box, track.motion, track.missed + 1);
+      for (std::size_t d = 0; d < detections.size(); d++) {
+        double cost = Metric::cost(track.predicted, detections[d]);
+        if (cost <= Metric::kMaxCost) {
+          pairs.push_back({cost, {t, d}});
+        }
+      }
+    }
+    std::sort(pairs.begin(), pairs.end(),
+              [](const Pair& a, const Pair& b) { return a.first < b.first; });
+
+    trackMatched.assign(trackList.size(), false);
+    detectionMatched.assign(detections.size(), false);
+    for (const auto& pair : pairs) {
+      std::size_t t = pair.second.first, d = pair.second.second;
+      if (trackMatched[t] || detectionMatched[d]) {
+        continue;
+      }
+      trackMatched[t] = detectionMatched[d] = true;
+      Track& track = trackList[t];
+      Motion::correct(track.motion, track.box, detections[d],
+                      track.missed + 1);
+      track.box = track.predicted = detections[d];
+      track.missed = 0;
+    }
+
+    std::size_t kept = 0;
+    for (std::size_t t = 0; t < trackList.size(); t++) {
+      Track& track = trackList[t];
+      if (!trackMatched[t] && (Geometry::atBorder(track.predicted) ||
+                               ++track.missed > MaxMissedFrames)) {
+        continue;
+      }
+      trackList[kept++] = track;
+    }
+    trackList.resize(kept);
+
+    for (std::size_t d = 0; d < detections.size(); d++) {
+      if (!detectionMatched[d]) {
+        trackList.push_back({++count, detections[d], detections[d],
+                             typename Motion::State(), 0});
+      }
+    }
+  }
+
+  /**
+   * @brief The current tracks.
+   * @return const std::vector<Track>& Tracks in creation order.
+   */
+  const std::vector<Track>& tracks() const { return trackList; }
+
+  /**
+   * @brief Gives a track another ID, e.g. one recovered by re-identification.
+   * The caller keeps the IDs unique and count at or above every ID in use.
+   * @param index Position of the track in tracks()
+   * @param id The new ID
+   */
+  void relabel(std::size_t index, int id) { trackList[index].id = id; }
+
+  /**
+   * @brief Replaces the tracks and the ID counter, e.g. from a checkpoint.
+   * @param lastId Last ID handed out, new tracks continue after it
+   * @param tracks The tracks to resume with
+   */
+  void restore(int lastId, const std::vector<Track>& tracks) {
+    count = lastId;
+    trackList = tracks;
+  }
+
+  /**
+   * @brief Distance of a track in the camera reference frame: pixel offsets
+   * of the box centre from the image centre and depth from Depth.
+   * @param track The track
+   * @return std::tuple<double, double, double> x, y and z distance.
+   */
+  std::tuple<double, double, double> cameraDistance(const Track& track) const {
+    double xDist = track.box.x - (Geometry::kWidth / 2) + (track.box.width / 2);
+    double yDist =
+        track.box.y - (Geometry::kHeight / 2) + (track.box.height / 2);
+    return std::make_tuple(xDist, yDist, Depth::depth(track.box.height));
+  }
+
+  /**
+   * @brief Distance of a track in the car reference frame, see toCar().
+   * @param track The track
+   * @return std::tuple<double, double, double> x, y and z distance.
+   */
+  std::tuple<double, double, double> carDistance(const Track& track) const {
+    return toCar(cameraDistance(track));
+  }
+
+  /**
+   * @brief Projects a camera frame distance into the car reference frame
+   * through the field of view and adds the mount offsets. The horizontal
+   * pixel offset is normalised by the frame width and the vertical one by
+   * the frame height.
+   * @param camera x and y pixel offsets from the image centre and depth
+   * @return std::tuple<double, double, double> x, y and z distance.
+   */
+  std::tuple<double, double, double> toCar(
+      const std::tuple<double, double, double>& camera) const {
+    double z = std::get<2>(camera);
+    double x = z * xScale * std::get<0>(camera);
+    double y = z * yScale * std::get<1>(camera);
+    return std::make_tuple(x + mount.xOffset, z + mount.yOffset,
+                           -y + mount.zOffset);
+  }
+
+  int count;  ///< Last ID handed out.
+
+ private:
+  using Pair = std::pair<double, std::pair<std::size_t, std::size_t>>;
+
+  CameraMount mount;  ///< Camera mounting.
+  double xScale, yScale;  ///< Field of view projection, computed once.
+  std::vector<Track> trackList;  ///< Current tracks.
+  std::vector<Pair> pairs;       ///< Candidate matches, reused per frame.
+  std::vector<bool> trackMatched, detectionMatched;  ///< Reused per frame.
+};
+
+/**
+ * @brief Association threshold of the bundled camera, 50 pixels.
+ *
+ */
+using VgaAssociationMetric = CentroidDistanceMetric<2500>;
+
+/**
+ * @brief Geometry of the bundled camera, 640x480 with a 10 pixel border.
+ *
+ */
+using VgaFrameGeometry = FrameGeometry<640, 480, 10>;
+
+/**
+ * @brief The configuration of the bundled camera: boxes are held at their
+ * last position and depth follows the piecewise model.
+ *
+ */
+using VgaTrackerCore = TrackerCore<VgaAssociationMetric, HoldMotionModel,
+                                   PiecewiseDepthModel, VgaFrameGeometry>;
+
+#endif  // TRACKER_CORE_HPP
@@ -27,6 +27,8 @@ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR I
 #include <bits/stdc++.h>
 
 #include <algorithm>
+#include <deque>
+#include <functional>
 #include <map>
 #include <numeric>
 #include <opencv2/core.hpp>
@@ -34,50 +36,87 @@ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR I
 #include <opencv2/imgproc.hpp>
 #include <string>
 
-#include "detection.hpp"
+#include "appearance.hpp"
+#include "tracker_core.hpp"
+
+/**
+ * @brief A single change to the set of tracked obstacles, emitted by
+ * TrackingClass::updateTracks().
+ *
+ */
+struct TrackEvent {
+  /**
+   * @brief What happened to the track in this frame.
+   *
+   */
+  enum Type { kCreated, kUpdated, kLost, kReacquired };
+  /**
+   * @brief Bit flags naming the fields of an updated box that changed.
+   *
+   */
+  enum Field { kPosition = 1, kSize = 2 };
+
+  Type type;     ///< Kind of change.
+  int id;        ///< ID of the obstacle the event refers to.
+  cv::Rect box;  ///< Current box, or the last known box for kLost.
+  int changed;   ///< Field flags that changed, only set for kUpdated.
+};
+
+/**
+ * @brief The state needed to resume tracking after a restart, see
+ * TrackingClass::snapshot() and TrackingClass::restore().
+ *
+ */
+struct TrackerState {
+  int count = 0;                         ///< Last ID handed out.
+  std::map<int, cv::Rect> tracks;        ///< Current obstacles.
+  std::map<int, int> missedFrames;       ///< Frames each track coasted.
+};
 
 /**
  * @class TrackingClass
  * @brief A class for Tracking Subjects on the Frame.
  *
- * This class takes the Image Frames as an inout and will
- * track any Human subjects as and when they are detected in the frame
+ * This class takes the detections of each frame and tracks any Human
+ * subjects as and when they are detected in the frame. Association, coasting
+ * and the distance models are those of VgaTrackerCore; this class adds track
+ * events, appearance based re-identification and snapshots on top.
  */
 class TrackingClass {
  public:
   /**
    * @brief Variables x, y and z that hold the values of distance between the
-   * Car reference frame and Camera reference frame
+   * Car reference frame and Camera reference frame. Fixed at construction,
+   * since the core precomputes its projection from them.
    */
-  double xOffset, yOffset, zOffset;
+  const double xOffset, yOffset, zOffset;
   /**
    * @brief Variables horizontalFOI, verticalFOI that hold the values for Camera
-   * Field of View
+   * Field of View, fixed at construction like the offsets.
    */
-  double horizontalFOI, verticalFOI;
+  const double horizontalFOI, verticalFOI;
   /**
-   * @brief Variable used to assign IDs to obstacles without overlap
+   * @brief Last ID handed out, a copy of the core counter. IDs are never
+   * reused, also not after frames without detections.
    *
    */
   int count;
   /**
-   * @brief Vector that holds the position of all obstacles found in image
-   * frame after assigning unique IDs
+   * @brief Map that holds the position of all obstacles found in image
+   * frame after assigning unique IDs, a copy of the core tracks refreshed by
+   * every update.
    *
    */
   std::map<int, cv::Rect> obstacleMapVector;
-  /**
-   * @brief Object of class DetectionClass (part-of relation), used to access
-   * the video stream and get detection of obstacles.
-   *
-   */
-  DetectionClass image;
   /**
    * @brief Constructor for TrackingClass.
+   * @param x Camera to car offset along the car x axis
+   * @param y Camera to car offset along the car y axis
+   * @param z Camera to car offset along the car z axis
+   * @param th Horizontal field of view in radians
+   * @param tv Vertical field of view in radians
    */
-  TrackingClass(const std::string& detectModelPath,
-                const std::string& detectConfigPath, double x, double y,
-                double z, double th, double tv);
+  TrackingClass(double x, double y, double z, double th, double tv);
 
   /**
    * @brief Destructor for TrackingClass.
@@ -94,17 +133,96 @@ class TrackingClass {
 
   /**
    * @brief Assigns IDs to objects.
-   * The function is called after face detection.
-   * The function assigns unique IDs in the first iteration of face detection.
-   * In subsequent iterations, the function will compare the the current
-   * obstacleMapVector with the new face detection and assign IDs to the new
-   * bounding box based on minimum Euclidean Distance
+   * The function is called after face detection. Detections are matched to
+   * the tracks of the previous frame by the distance of their centres,
+   * unmatched detections get new IDs and unmatched tracks coast at their last
+   * box until they reach the frame border or miss too many frames.
    *
-   * @param detections
+   * @param detections A vector containing all the detected faces in the frame
    * @return std::map<int, cv::Rect> A map containing object IDs and
    * descriptions.
    */
-  std::map<int, cv::Rect> assignIDAndTrack(std::vector<cv::Rect>& detections);
+  std::map<int, cv::Rect> assignIDAndTrack(
+      const std::vector<cv::Rect>& detections);
+
+  /**
+   * @brief Incremental counterpart of assignIDAndTrack().
+   * Updates obstacleMapVector in place and reports only what changed: new
+   * tracks, moved or resized tracks, tracks that were dropped and tracks that
+   * were matched again after coasting through missed detections. Every event
+   * is passed to the subscribers and appended to the event queue.
+   *
+   * @param detections A vector containing all the detected faces in the frame
+   * @return const std::vector<TrackEvent>& The events of this frame, valid
+   * until the next call.
+   */
+  const std::vector<TrackEvent>& updateTracks(
+      const std::vector<cv::Rect>& detections);
+
+  /**
+   * @brief updateTracks() with appearance based re-identification.
+   * Dropped tracks are kept in a small gallery together with an HSV
+   * histogram of their last box. A new detection that matches one of them
+   * gets the old ID back and is reported as re-acquired instead of created.
+   * A new detection only gets a fresh ID after the gallery lookup, so a
+   * re-identified obstacle does not use one up.
+   *
+   * @param detections A vector containing all the detected faces in the frame
+   * @param frame The frame the detections were found in
+   * @param trackSpace Resolution the detections are given in, empty if they
+   * are in frame coordinates
+   * @return const std::vector<TrackEvent>& The events of this frame, valid
+   * until the next call.
+   */
+  const std::vector<TrackEvent>& updateTracks(
+      const std::vector<cv::Rect>& detections, const cv::Mat& frame,
+      const cv::Size& trackSpace = cv::Size());
+
+  /**
+   * @brief Registers a callback that is invoked for every track event.
+   *
+   * @param callback Function called synchronously from updateTracks()
+   */
+  void subscribe(std::function<void(const TrackEvent&)> callback);
+
+  /**
+   * @brief Returns and clears all queued track events. At most
+   * maxQueuedEvents are kept, older events are dropped first.
+   *
+   * @return std::vector<TrackEvent> The queued events in emission order.
+   */
+  std::vector<TrackEvent> drainEvents();
+
+  /**
+   * @brief Copies the tracks, the ID counter and the coasting state.
+   *
+   * @param state Receives the state; its storage is reused, so a state kept
+   * across frames does not allocate once the track table stops growing
+   */
+  void snapshot(TrackerState& state) const;
+
+  /**
+   * @brief Replaces the tracker state, e.g. from a checkpoint on boot. The
+   * restored tracks keep their IDs and new IDs continue after state.count,
+   * or after the highest restored ID if that is larger.
+   * Pending events, appearance descriptors and the gallery are cleared.
+   *
+   * @param state The state to resume from
+   */
+  void restore(const TrackerState& state);
+
+  /**
+   * @brief Upper bound of the event queue, so that a consumer which never
+   * drains cannot grow memory without limit.
+   *
+   */
+  std::size_t maxQueuedEvents = 1024;
+
+  /**
+   * @brief Recently lost tracks available for re-identification.
+   *
+   */
+  AppearanceGallery gallery;
 
   /**
    * @brief Calculates the distance of an object from the camera.
@@ -130,6 +248,31 @@ class TrackingClass {
    */
   std::map<int, std::tuple<double, double, double>> distFromCar(
       std::map<int, std::tuple<double, double, double>>& input);
+
+ private:
+  /**
+   * @brief Copies the core tracks into obstacleMapVector and missedFrames.
+   */
+  void mirrorCore();
+
+  /**
+   * @brief Passes an event to the subscribers and the event queue.
+   *
+   * @param event The event to publish
+   */
+  void publish(const TrackEvent& event);
+
+  VgaTrackerCore core;  ///< Association, coasting and distance models.
+  std::map<int, cv::Rect> previousTracks;  ///< Tracks before the update.
+  std::map<int, int> previousMissed;       ///< Coasting before the update.
+  std::map<int, cv::Rect> lostTracks;      ///< Dropped IDs, last boxes.
+  std::map<int, int> missedFrames;  ///< Frames each track coasted unmatched.
+  std::map<int, cv::Mat> appearance;  ///< Latest descriptor of each track.
+  std::vector<int> reidentifiedIds;   ///< IDs recovered from the gallery.
+  std::vector<int> createdIds;        ///< IDs created this frame.
+  std::vector<TrackEvent> frameEvents;  ///< Events of the latest frame.
+  std::deque<TrackEvent> eventQueue;    ///< Events awaiting drainEvents().
+  std::vector<std::function<void(const TrackEvent&)>> subscribers;
 };
 
 #endif
\ No newline at end of file
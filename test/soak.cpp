@@ -0,0 +1,387 @@
+/**
+Copyright © 2023 <copyright holders>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the “Software”), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/**
+ * @file soak.cpp
+ * @author Lowell Lobo
+ * @author Mayank Deshpande
+ * @author Kautilya Chappidi
+ * @brief Long running soak test of the detection and tracking loop. Loops the
+ * bundled video (or synthetic detections) for a configurable duration, samples
+ * memory, allocation, track table, ID and latency statistics at fixed
+ * intervals and fails on monotonic growth, ID churn or latency drift.
+ * @version 0.1
+ * @date 2023-11-06
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "detection.hpp"
+#include "tracking.hpp"
+
+/**
+ * @brief Number of live heap allocations made through operator new. cv::Mat
+ * buffers come from cv::fastMalloc and are not counted; leaks in OpenCV only
+ * show up in the RSS samples.
+ *
+ */
+static std::atomic<long> liveAllocations(0);
+
+void* operator new(std::size_t size) {
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  liveAllocations.fetch_add(1, std::memory_order_relaxed);
+  return ptr;
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void* ptr) noexcept {
+  if (ptr != nullptr) {
+    liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+    std::free(ptr);
+  }
+}
+
+void operator delete[](void* ptr) noexcept { operator delete(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { operator delete(ptr); }
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+  operator delete(ptr);
+}
+
+/**
+ * @brief One row of the soak report, taken at the end of every interval.
+ *
+ */
+struct SoakSample {
+  double elapsed;        ///< Seconds since the start of the run.
+  long rssKb;            ///< Resident set size in KiB.
+  long allocations;      ///< Live heap allocations.
+  std::size_t tracks;    ///< Size of obstacleMapVector.
+  int idCounter;         ///< Value of TrackingClass::count.
+  long newIds;           ///< IDs issued during the interval.
+  long frames;           ///< Frames processed in the interval.
+  double p50, p95, p99;  ///< Per-frame latency percentiles in milliseconds.
+};
+
+/**
+ * @brief Reads the resident set size of this process from procfs.
+ *
+ * @return long RSS in KiB, 0 if procfs is unavailable.
+ */
+static long residentKb() {
+  std::ifstream statm("/proc/self/statm");
+  long pages = 0, resident = 0;
+  statm >> pages >> resident;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * @brief Returns a percentile of the latencies, partially reordering them.
+ *
+ * @param latencies Latencies of the interval in milliseconds
+ * @param fraction Percentile as a fraction between 0 and 1
+ * @return double The percentile, 0 for an empty interval.
+ */
+static double percentile(std::vector<double>& latencies, double fraction) {
+  if (latencies.empty()) {
+    return 0.0;
+  }
+  auto nth = latencies.begin() +
+             static_cast<std::size_t>(fraction * (latencies.size() - 1));
+  std::nth_element(latencies.begin(), nth, latencies.end());
+  return *nth;
+}
+
+/**
+ * @brief Checks whether a series never decreases and rises in at least half
+ * of its steps, which over a long run is the signature of a leak. A value that
+ * steps up once and then plateaus is not reported.
+ *
+ * @param values Sampled values after warm-up
+ * @return True if the series grows monotonically.
+ */
+static bool growsMonotonically(const std::vector<double>& values) {
+  if (values.size() < 4) {
+    return false;
+  }
+  std::size_t rises = 0;
+  for (std::size_t i = 1; i < values.size(); i++) {
+    if (values[i] < values[i - 1]) {
+      return false;
+    }
+    rises += values[i] > values[i - 1] ? 1 : 0;
+  }
+  return 2 * rises >= values.size() - 1;
+}
+
+/**
+ * @brief Produces synthetic detections of people walking across a 640x480
+ * frame, entering, leaving and being missed now and then, so the tracker is
+ * exercised with ID churn without running the network.
+ *
+ * @param frame Index of the frame
+ * @return std::vector<cv::Rect> The detections of the frame.
+ */
+static std::vector<cv::Rect> syntheticDetections(long frame) {
+  std::vector<cv::Rect> detections;
+  for (int person = 0; person < 3; person++) {
+    long phase = (frame + person * 97) % 400;
+    if (phase >= 300 || (frame + person) % 23 == 0) {
+      continue;  // off screen or missed by the detector
+    }
+    int x = 20 + static_cast<int>(phase * 2) % 520;
+    int y = 120 + static_cast<int>(40 * std::sin(phase / 30.0)) + person * 60;
+    int size = 60 + person * 20;
+    detections.push_back(cv::Rect(x, y, size, size));
+  }
+  return detections;
+}
+
+/**
+ * @brief Paints the synthetic people into a frame, each in its own colour, so
+ * that the appearance descriptors and the re-identification gallery are
+ * exercised as well.
+ *
+ * @param detections The detections of the frame
+ * @param frame Reused 640x480 frame, repainted in place
+ */
+static void drawSynthetic(const std::vector<cv::Rect>& detections,
+                          cv::Mat& frame) {
+  const cv::Scalar colors[] = {cv::Scalar(0, 0, 200), cv::Scalar(200, 0, 0),
+                               cv::Scalar(0, 200, 0)};
+  frame.create(480, 640, CV_8UC3);
+  frame.setTo(cv::Scalar(60, 60, 60));
+  for (std::size_t i = 0; i < detections.size(); i++) {
+    cv::Rect box = detections[i] & cv::Rect(0, 0, frame.cols, frame.rows);
+    // The people differ in size, which identifies them
+    frame(box).setTo(colors[(detections[i].height - 60) / 20 % 3]);
+  }
+}
+
+/**
+ * @brief Runs the soak test.
+ *
+ * Options: --duration SECONDS, --interval SECONDS, --video PATH, --synthetic,
+ * --max-rss-growth-kb KB, --max-latency-drift RATIO, --max-tracks N and
+ * --max-id-rate IDS, the new IDs allowed per 100 frames in any interval.
+ *
+ * @param argc
+ * @param argv
+ * @return int 0 if every check passed, 1 otherwise.
+ */
+int main(int argc, char** argv) {
+  double duration = 60, interval = 5;
+  std::string video = "../../assets/video.mp4";
+  bool synthetic = false;
+  long maxRssGrowthKb = 64 * 1024;
+  double maxLatencyDrift = 1.5;
+  std::size_t maxTracks = 64;
+  double maxIdRate = 5;
+
+  for (int i = 1; i < argc; i++) {
+    std::string name = argv[i];
+    if (name == "--synthetic") {
+      synthetic = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << name << std::endl;
+      return 1;
+    }
+    std::string value = argv[++i];
+    if (name == "--duration") {
+      duration = std::atof(value.c_str());
+    } else if (name == "--interval") {
+      interval = std::atof(value.c_str());
+    } else if (name == "--video") {
+      video = value;
+    } else if (name == "--max-rss-growth-kb") {
+      maxRssGrowthKb = std::atol(value.c_str());
+    } else if (name == "--max-latency-drift") {
+      maxLatencyDrift = std::atof(value.c_str());
+    } else if (name == "--max-tracks") {
+      maxTracks = std::atol(value.c_str());
+    } else if (name == "--max-id-rate") {
+      maxIdRate = std::atof(value.c_str());
+    } else {
+      std::cerr << "Unknown option " << name << std::endl;
+      return 1;
+    }
+  }
+
+  DetectionClass detector(
+      "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
+      "../../models/deploy.prototxt");
+  TrackingClass tracker(0, 0, 0, 1.57, 0.7);
+  cv::VideoCapture capture;
+  if (!synthetic && !capture.open(video)) {
+    std::cerr << "Cannot open " << video << std::endl;
+    return 1;
+  }
+
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+  auto nextSample = start + std::chrono::duration<double>(interval);
+  std::vector<SoakSample> samples;
+  std::vector<double> latencies;
+  cv::Mat frame;
+  long frameIndex = 0;
+  int lastIdCounter = 0;
+  long issuedIds = 0;
+
+  std::cout << std::setw(9) << "elapsed" << std::setw(10) << "rss_kb"
+            << std::setw(10) << "allocs" << std::setw(8) << "tracks"
+            << std::setw(8) << "ids" << std::setw(8) << "new" << std::setw(10)
+            << "frames"
+            << std::setw(9) << "p50_ms" << std::setw(9) << "p95_ms"
+            << std::setw(9) << "p99_ms" << std::endl;
+
+  while (true) {
+    std::vector<cv::Rect> detections;
+    auto frameStart = Clock::now();
+    if (synthetic) {
+      detections = syntheticDetections(frameIndex);
+      drawSynthetic(detections, frame);
+    } else {
+      capture >> frame;
+      if (frame.empty()) {
+        // Loop the video by reopening it. Give up if that fails or yields no
+        // frame, otherwise the soak would spin here without ever sampling
+        capture.release();
+        if (!capture.open(video) || !capture.read(frame) || frame.empty()) {
+          std::cerr << "Cannot reopen " << video << std::endl;
+          return 1;
+        }
+        frameStart = Clock::now();
+      }
+      detections = detector.detectFaces(frame);
+    }
+    tracker.updateTracks(detections, frame);
+    tracker.drainEvents();
+    // count never restarts, so its growth is the number of IDs issued
+    issuedIds += tracker.count - lastIdCounter;
+    lastIdCounter = tracker.count;
+    auto frameEnd = Clock::now();
+    latencies.push_back(
+        std::chrono::duration<double, std::milli>(frameEnd - frameStart)
+            .count());
+    frameIndex++;
+
+    if (frameEnd < nextSample) {
+      continue;
+    }
+    SoakSample sample;
+    sample.elapsed = std::chrono::duration<double>(frameEnd - start).count();
+    sample.rssKb = residentKb();
+    sample.allocations = liveAllocations.load();
+    sample.tracks = tracker.obstacleMapVector.size();
+    sample.idCounter = tracker.count;
+    sample.newIds = issuedIds;
+    issuedIds = 0;
+    sample.frames = static_cast<long>(latencies.size());
+    sample.p50 = percentile(latencies, 0.50);
+    sample.p95 = percentile(latencies, 0.95);
+    sample.p99 = percentile(latencies, 0.99);
+    samples.push_back(sample);
+    latencies.clear();
+    nextSample += std::chrono::duration<double>(interval);
+
+    std::cout << std::fixed << std::setprecision(1) << std::setw(9)
+              << sample.elapsed << std::setw(10) << sample.rssKb
+              << std::setw(10) << sample.allocations << std::setw(8)
+              << sample.tracks << std::setw(8) << sample.idCounter
+              << std::setw(8) << sample.newIds << std::setw(10)
+              << sample.frames << std::setprecision(3)
+              << std::setw(9) << sample.p50 << std::setw(9) << sample.p95
+              << std::setw(9) << sample.p99 << std::endl;
+
+    if (sample.elapsed >= duration) {
+      break;
+    }
+  }
+
+  // The first interval includes model warm-up and allocator growth
+  if (samples.size() > 1) {
+    samples.erase(samples.begin());
+  }
+  std::vector<double> rss, allocations, tracks;
+  std::size_t peakTracks = 0;
+  double peakIdRate = 0;
+  for (const auto& sample : samples) {
+    if (sample.frames > 0) {
+      peakIdRate = std::max(peakIdRate, 100.0 * sample.newIds / sample.frames);
+    }
+    rss.push_back(sample.rssKb);
+    allocations.push_back(sample.allocations);
+    tracks.push_back(sample.tracks);
+    peakTracks = std::max(peakTracks, sample.tracks);
+  }
+
+  bool passed = true;
+  long rssGrowth = samples.back().rssKb - samples.front().rssKb;
+  if (growsMonotonically(rss) && rssGrowth > maxRssGrowthKb) {
+    std::cerr << "FAIL: RSS grew monotonically by " << rssGrowth << " KiB"
+              << std::endl;
+    passed = false;
+  }
+  if (growsMonotonically(allocations)) {
+    std::cerr << "FAIL: live allocations grew monotonically from "
+              << samples.front().allocations << " to "
+              << samples.back().allocations << std::endl;
+    passed = false;
+  }
+  if (growsMonotonically(tracks) || peakTracks > maxTracks) {
+    std::cerr << "FAIL: track table reached " << peakTracks << " entries"
+              << std::endl;
+    passed = false;
+  }
+  if (peakIdRate > maxIdRate) {
+    std::cerr << "FAIL: " << peakIdRate
+              << " new IDs per 100 frames in one interval" << std::endl;
+    passed = false;
+  }
+  // Compare the p95 of the first and last quarter of the run; drift below
+  // half a millisecond is scheduler noise rather than a trend
+  std::size_t quarter = std::max<std::size_t>(1, samples.size() / 4);
+  double earlyP95 = 0, lateP95 = 0;
+  for (std::size_t i = 0; i < quarter; i++) {
+    earlyP95 += samples[i].p95 / quarter;
+    lateP95 += samples[samples.size() - 1 - i].p95 / quarter;
+  }
+  if (lateP95 > maxLatencyDrift * earlyP95 && lateP95 - earlyP95 > 0.5) {
+    std::cerr << "FAIL: p95 latency drifted from " << earlyP95 << " ms to "
+              << lateP95 << " ms" << std::endl;
+    passed = false;
+  }
+
+  std::cout << (passed ? "PASS" : "FAIL") << " after " << frameIndex
+            << " frames" << std::endl;
+  return passed ? 0 : 1;
+}
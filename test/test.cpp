@@ -13,25 +13,33 @@
  */
 
 #include <gtest/gtest.h>
+#include <sched.h>
 
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <fstream>
 #include <iostream>
+#include <thread>
 #include <tuple>
 #include <utility>
 #include <vector>
 #include <opencv2/core.hpp>
 #include <opencv2/core/types.hpp>
 
+#include "appearance.hpp"
+#include "batch.hpp"
+#include "checkpoint.hpp"
 #include "detection.hpp"
+#include "displaying.hpp"
+#include "threading.hpp"
 #include "tracking.hpp"
 
 /**
  * @brief static TrackingClass object to be used in the unit test
  *
  */
-// static TrackingClass
-// obj_("../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
-// "../../models/deploy.prototxt", 0, 0, 0, 1.57, 0.7);
+// static TrackingClass obj_(0, 0, 0, 1.57, 0.7);
 
 /**
  * @brief Construct a new TEST object.
@@ -70,9 +78,7 @@ TEST(unit_test_assign_ID, this_should_pass) {
   DetectionClass obj(
       "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
       "../../models/deploy.prototxt");
-  TrackingClass obj_(
-      "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
-      "../../models/deploy.prototxt", 0, 0, 0, 1.57, 0.7);
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
   cv::Mat frame = cv::imread("../../assets/faceImage.jpg");
   auto val = obj.detectFaces(frame);
   auto ids = obj_.assignIDAndTrack(val);
@@ -88,9 +94,7 @@ TEST(unit_test_dist_from_camera, this_should_pass) {
   DetectionClass obj(
       "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
       "../../models/deploy.prototxt");
-  TrackingClass obj_(
-      "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
-      "../../models/deploy.prototxt", 0, 0, 0, 1.57, 0.7);
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
   cv::Mat frame = cv::imread("../../assets/faceImage.jpg");
   auto val = obj.detectFaces(frame);
   obj_.obstacleMapVector = obj_.assignIDAndTrack(val);
@@ -110,9 +114,7 @@ TEST(unit_test_dist_from_car, this_should_pass) {
   DetectionClass obj(
       "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
       "../../models/deploy.prototxt");
-  TrackingClass obj_(
-      "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
-      "../../models/deploy.prototxt", 0, 0, 0, 1.57, 0.7);
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
   cv::Mat frame = cv::imread("../../assets/multi_faces.jpg");
   auto val = obj.detectFaces(frame);
   obj_.obstacleMapVector = obj_.assignIDAndTrack(val);
@@ -133,9 +135,7 @@ TEST(unit_test_find_depth, this_should_pass) {
   DetectionClass obj(
       "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
       "../../models/deploy.prototxt");
-  TrackingClass obj_(
-      "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
-      "../../models/deploy.prototxt", 0, 0, 0, 1.57, 0.7);
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
   cv::Mat frame = cv::imread("../../assets/multi_faces.jpg");
   auto val = obj.detectFaces(frame);
   obj_.obstacleMapVector = obj_.assignIDAndTrack(val);
@@ -152,9 +152,7 @@ TEST(unit_test_assign_ID_2, this_should_pass) {
   DetectionClass obj(
       "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
       "../../models/deploy.prototxt");
-  TrackingClass obj_(
-      "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
-      "../../models/deploy.prototxt", 0, 0, 0, 1.57, 0.7);
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
   cv::VideoCapture videoCapture("../../assets/video.mp4");
   cv::Mat frame;
   while (true) {
@@ -177,9 +175,7 @@ TEST(unit_test_no_face, this_should_pass) {
   DetectionClass obj(
       "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
       "../../models/deploy.prototxt");
-  TrackingClass obj_(
-      "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
-      "../../models/deploy.prototxt", 0, 0, 0, 1.57, 0.7);
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
   cv::Mat frame = cv::imread("../../assets/no_face.jpg");
   auto val = obj.detectFaces(frame);
   obj_.obstacleMapVector = obj_.assignIDAndTrack(val);
@@ -196,9 +192,7 @@ TEST(unit_test_close_face, this_should_pass) {
   DetectionClass obj(
       "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
       "../../models/deploy.prototxt");
-  TrackingClass obj_(
-      "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
-      "../../models/deploy.prototxt", 0, 0, 0, 1.57, 0.7);
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
   cv::Mat frame = cv::imread("../../assets/too_close.jpg");
   auto val = obj.detectFaces(frame);
   obj_.obstacleMapVector = obj_.assignIDAndTrack(val);
@@ -206,3 +200,732 @@ TEST(unit_test_close_face, this_should_pass) {
 
   EXPECT_EQ(depth, 0);
 }
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking the cpu list parsing of class ThreadPlacement
+ */
+TEST(unit_test_parse_cpu_list, this_should_pass) {
+  EXPECT_EQ(ThreadPlacement::parseCpuList("0-2,5"),
+            std::vector<int>({0, 1, 2, 5}));
+  EXPECT_TRUE(ThreadPlacement::parseCpuList("3-1").empty());
+  EXPECT_TRUE(ThreadPlacement::parseCpuList("a").empty());
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking the option parsing and pinning of class
+ * ThreadPlacement
+ */
+TEST(unit_test_thread_placement, this_should_pass) {
+  ThreadPlacement placement;
+  EXPECT_TRUE(placement.parseOption("--inference-cpus", "0"));
+  EXPECT_TRUE(placement.parseOption("--dnn-threads", "1"));
+  EXPECT_FALSE(placement.parseOption("--dnn-threads", "abc"));
+  EXPECT_FALSE(placement.parseOption("--dnn-threads", "0"));
+  EXPECT_EQ(placement.dnnThreads, 1);
+  EXPECT_FALSE(placement.parseOption("--capture-priority", "high"));
+  EXPECT_FALSE(placement.parseOption("--unknown", "0"));
+  EXPECT_FALSE(placement.parseOption("--tracking-cpus", "0"));
+  EXPECT_FALSE(placement.parseOption("--capture-cpus", "node-1"));
+  EXPECT_FALSE(placement.parseOption("--capture-cpus", "nodex"));
+
+  int count = 7;
+  EXPECT_TRUE(ThreadPlacement::parseCount("12", count));
+  EXPECT_EQ(count, 12);
+  EXPECT_FALSE(ThreadPlacement::parseCount("4x", count));
+  EXPECT_FALSE(ThreadPlacement::parseCount("", count));
+  EXPECT_FALSE(ThreadPlacement::parseCount("-1", count));
+  EXPECT_FALSE(ThreadPlacement::parseCount("99999999999", count));
+  EXPECT_EQ(count, 12);
+
+  // A thread started from the pinned inference thread does not keep its cores
+  cpu_set_t process;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(process), &process), 0);
+  int outputCores = 0;
+  std::thread worker([&]() {
+    EXPECT_TRUE(placement.pinCurrentThread(ThreadRole::kInference));
+    std::thread output([&]() {
+      EXPECT_TRUE(placement.pinCurrentThread(ThreadRole::kOutput));
+      cpu_set_t mask;
+      sched_getaffinity(0, sizeof(mask), &mask);
+      outputCores = CPU_COUNT(&mask);
+    });
+    output.join();
+  });
+  worker.join();
+  EXPECT_EQ(outputCores, CPU_COUNT(&process));
+  EXPECT_NE(placement.topologyReport().find("1 cores [0]"), std::string::npos);
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking the track events of class TrackingClass
+ */
+TEST(unit_test_track_events, this_should_pass) {
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
+  int callbacks = 0;
+  obj_.subscribe([&callbacks](const TrackEvent&) { callbacks++; });
+
+  std::vector<cv::Rect> detections = {cv::Rect(100, 100, 50, 50)};
+  auto events = obj_.updateTracks(detections);
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].type, TrackEvent::kCreated);
+  EXPECT_EQ(events[0].id, 1);
+
+  detections = {cv::Rect(110, 100, 50, 50)};
+  events = obj_.updateTracks(detections);
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].type, TrackEvent::kUpdated);
+  EXPECT_EQ(events[0].changed, TrackEvent::kPosition);
+
+  detections = {cv::Rect(110, 100, 50, 50)};
+  EXPECT_TRUE(obj_.updateTracks(detections).empty());
+
+  // Away from the border the track coasts for 30 frames before it is lost
+  detections.clear();
+  for (int i = 0; i < 30; i++) {
+    EXPECT_TRUE(obj_.updateTracks(detections).empty());
+  }
+  EXPECT_EQ(obj_.obstacleMapVector.size(), 1);
+  events = obj_.updateTracks(detections);
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].type, TrackEvent::kLost);
+  EXPECT_TRUE(obj_.obstacleMapVector.empty());
+
+  EXPECT_EQ(callbacks, 3);
+  EXPECT_EQ(obj_.drainEvents().size(), 3);
+  EXPECT_TRUE(obj_.drainEvents().empty());
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking that a coasting track of class TrackingClass is
+ * reported as re-acquired when it is matched again
+ */
+TEST(unit_test_track_reacquired, this_should_pass) {
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
+  std::vector<cv::Rect> detections = {cv::Rect(100, 100, 50, 50)};
+  obj_.updateTracks(detections);
+  detections = {cv::Rect(300, 100, 50, 50), cv::Rect(100, 100, 50, 50)};
+  obj_.updateTracks(detections);
+  ASSERT_EQ(obj_.obstacleMapVector.size(), 2);
+
+  // One detection for two tracks, the second track coasts
+  detections = {cv::Rect(100, 100, 50, 50)};
+  EXPECT_EQ(obj_.updateTracks(detections).size(), 0);
+  EXPECT_EQ(obj_.obstacleMapVector.size(), 2);
+
+  detections = {cv::Rect(300, 100, 50, 50), cv::Rect(100, 100, 50, 50)};
+  auto events = obj_.updateTracks(detections);
+  bool reacquired = false;
+  for (const auto& event : events) {
+    reacquired |= event.type == TrackEvent::kReacquired && event.id == 2;
+  }
+  EXPECT_TRUE(reacquired);
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test checking that the IDs of class TrackingClass follow two obstacles
+ * whose paths cross horizontally at different heights
+ */
+TEST(unit_test_track_crossing, this_should_pass) {
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
+  std::vector<cv::Rect> detections = {cv::Rect(100, 100, 50, 50),
+                                      cv::Rect(300, 200, 50, 50)};
+  obj_.updateTracks(detections);
+  ASSERT_EQ(obj_.obstacleMapVector.size(), 2);
+  for (int step = 1; step <= 10; step++) {
+    // Listed right to left, so the nearest in x alone would swap the IDs
+    cv::Rect first(100 + 20 * step, 100, 50, 50);
+    cv::Rect second(300 - 20 * step, 200, 50, 50);
+    detections = {second, first};
+    obj_.updateTracks(detections);
+    ASSERT_EQ(obj_.obstacleMapVector.size(), 2);
+    EXPECT_EQ(obj_.obstacleMapVector[1], first);
+    EXPECT_EQ(obj_.obstacleMapVector[2], second);
+  }
+  EXPECT_EQ(obj_.count, 2);
+}
+
+/**
+ * @brief Intersection over union of two boxes.
+ *
+ * @param a First box
+ * @param b Second box
+ * @return double Overlap between 0 and 1.
+ */
+static double intersectionOverUnion(const cv::Rect& a, const cv::Rect& b) {
+  double overlap = (a & b).area();
+  double total = a.area() + b.area() - overlap;
+  return total > 0 ? overlap / total : 0;
+}
+
+/**
+ * @brief Runs a single stage detector and a detector with a prefilter over
+ * the bundled assets. A frame agrees when both return the same number of
+ * boxes and every single stage box overlaps a cascaded one with an IoU of at
+ * least 0.99, so a rejected frame only agrees if the single stage finds
+ * nothing in it either.
+ *
+ * @param mode The prefilter to enable
+ * @param cascadePath Cascade file for kCascade
+ * @param rounds Timed rounds over the assets, agreement is taken from the
+ * first
+ * @param screened Receives the number of frames screened by the prefilter
+ * @return int The number of assets on which both detectors agree.
+ */
+static int prefilterAgreement(PrefilterMode mode,
+                              const std::string& cascadePath, int rounds,
+                              int& screened) {
+  DetectionClass single(
+      "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
+      "../../models/deploy.prototxt");
+  DetectionClass cascaded(
+      "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
+      "../../models/deploy.prototxt");
+  EXPECT_TRUE(cascaded.enablePrefilter(mode, cascadePath));
+
+  const std::vector<std::string> assets = {
+      "../../assets/faceImage.jpg", "../../assets/multi_faces.jpg",
+      "../../assets/no_face.jpg", "../../assets/too_close.jpg"};
+  std::vector<cv::Mat> frames;
+  for (const auto& asset : assets) {
+    frames.push_back(cv::imread(asset));
+  }
+  // Warm up both detectors so that layer allocation is not timed
+  single.detectFaces(frames[0]);
+  cascaded.detectFaces(frames[0]);
+  cascaded.enablePrefilter(mode, cascadePath);
+
+  int agreeing = 0;
+  double singleMs = 0, cascadedMs = 0;
+  for (int round = 0; round < rounds; round++) {
+    for (std::size_t i = 0; i < frames.size(); i++) {
+      auto start = std::chrono::steady_clock::now();
+      auto expected = single.detectFaces(frames[i]);
+      auto middle = std::chrono::steady_clock::now();
+      auto actual = cascaded.detectFaces(frames[i]);
+      auto end = std::chrono::steady_clock::now();
+      singleMs +=
+          std::chrono::duration<double, std::milli>(middle - start).count();
+      cascadedMs +=
+          std::chrono::duration<double, std::milli>(end - middle).count();
+      if (round > 0) {
+        continue;
+      }
+      bool same = expected.size() == actual.size();
+      for (const auto& box : expected) {
+        bool overlapping = false;
+        for (const auto& other : actual) {
+          overlapping |= intersectionOverUnion(box, other) >= 0.99;
+        }
+        same &= overlapping;
+      }
+      if (same) {
+        agreeing++;
+      } else {
+        std::cout << assets[i] << ": single stage " << expected.size()
+                  << ", cascaded " << actual.size() << std::endl;
+      }
+    }
+  }
+  screened = cascaded.framesScreened;
+  std::cout << "Prefilter agreement " << agreeing << "/" << assets.size()
+            << ", skipped " << cascaded.framesRejected << "/"
+            << cascaded.framesScreened << " frames, "
+            << singleMs / cascaded.framesScreened << " ms single stage vs "
+            << cascadedMs / cascaded.framesScreened << " ms cascaded per frame"
+            << std::endl;
+  EXPECT_EQ(cascaded.framesRejected % rounds, 0);
+  return agreeing;
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test measuring the agreement of the low resolution prefilter of class
+ * DetectionClass with the single stage path on the bundled assets
+ */
+TEST(unit_test_prefilter_agreement, this_should_pass) {
+  int screened = 0;
+  EXPECT_EQ(prefilterAgreement(PrefilterMode::kLowResNet, "", 5, screened), 4);
+  EXPECT_EQ(screened, 5 * 4);
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test measuring the agreement of the bundled Haar cascade prefilter of
+ * class DetectionClass with the single stage path on the bundled assets
+ */
+TEST(unit_test_prefilter_cascade, this_should_pass) {
+  const std::string cascade =
+      "../../models/haarcascade_frontalface_default.xml";
+  int screened = 0;
+  EXPECT_EQ(prefilterAgreement(PrefilterMode::kCascade, cascade, 5, screened),
+            4);
+  EXPECT_EQ(screened, 5 * 4);
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking that enablePrefilter of class DetectionClass refuses
+ * a missing cascade file
+ */
+TEST(unit_test_prefilter_cascade_missing, this_should_pass) {
+  DetectionClass obj(
+      "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
+      "../../models/deploy.prototxt");
+  EXPECT_FALSE(obj.enablePrefilter(PrefilterMode::kCascade, ""));
+  EXPECT_FALSE(
+      obj.enablePrefilter(PrefilterMode::kCascade, "../../models/missing.xml"));
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking the drawObjectLocations method of class DisplayClass
+ */
+TEST(unit_test_draw_preview, this_should_pass) {
+  DisplayClass display("Image", 0.5);
+  cv::Mat frame(480, 640, CV_8UC3, cv::Scalar(0, 0, 0));
+  std::map<int, cv::Rect> tracks = {{1, cv::Rect(100, 100, 80, 80)}};
+  std::map<int, std::tuple<double, double, double>> distances = {
+      {1, std::make_tuple(1.0, 2.0, 3.0)}};
+
+  cv::Mat preview = display.drawObjectLocations(frame, tracks, distances);
+
+  EXPECT_EQ(preview.cols, 320);
+  EXPECT_EQ(preview.rows, 240);
+  EXPECT_GT(cv::sum(preview)[0], 0);
+  EXPECT_EQ(cv::sum(frame)[0], 0);
+
+  // Only the ID prefix is cached, the distances are drawn every frame
+  distances[1] = std::make_tuple(7.0, 8.0, 9.0);
+  cv::Mat moved = display.drawObjectLocations(frame, tracks, distances);
+  EXPECT_GT(cv::norm(preview, moved, cv::NORM_L1), 0);
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking the mapToFullResolution method of class
+ * DetectionClass
+ */
+TEST(unit_test_map_to_full_resolution, this_should_pass) {
+  VideoFrame frame;
+  frame.working = cv::Mat(180, 320, CV_8UC3, cv::Scalar(0, 0, 0));
+  frame.fullSize = cv::Size(1280, 720);
+  auto boxes =
+      DetectionClass::mapToFullResolution({cv::Rect(10, 20, 30, 40)}, frame);
+
+  ASSERT_EQ(boxes.size(), 1);
+  EXPECT_EQ(boxes[0], cv::Rect(40, 80, 120, 160));
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking the readFrame method of class DetectionClass with a
+ * working resolution and frame decimation
+ */
+TEST(unit_test_read_working_frame, this_should_pass) {
+  DetectionClass obj(
+      "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
+      "../../models/deploy.prototxt");
+  ASSERT_TRUE(obj.initVideoStream("../../assets/video.mp4", cv::Size(320, 180),
+                                  true, 10));
+  VideoFrame frame;
+  ASSERT_TRUE(obj.readFrame(frame));
+
+  EXPECT_EQ(frame.working.cols, 320);
+  EXPECT_EQ(frame.working.rows, 180);
+  EXPECT_EQ(frame.full.size(), frame.fullSize);
+  auto faces = DetectionClass::mapToFullResolution(
+      obj.detectFaces(frame.working), frame);
+  for (const auto& face : faces) {
+    EXPECT_LE(face.x + face.width, frame.fullSize.width + 1);
+  }
+
+  // A camera index that overflows int is refused instead of throwing
+  EXPECT_FALSE(obj.initVideoStream("99999999999", cv::Size(320, 180), true));
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking the descriptors and LRU behaviour of class
+ * AppearanceGallery
+ */
+TEST(unit_test_appearance_gallery, this_should_pass) {
+  cv::Mat frame(100, 200, CV_8UC3, cv::Scalar(0, 0, 255));
+  frame(cv::Rect(100, 0, 100, 100)).setTo(cv::Scalar(255, 0, 0));
+  cv::Mat red = AppearanceGallery::describe(frame, cv::Rect(10, 10, 50, 50));
+  cv::Mat blue = AppearanceGallery::describe(frame, cv::Rect(120, 10, 50, 50));
+
+  EXPECT_NEAR(AppearanceGallery::similarity(red, red), 1.0, 1e-5);
+  EXPECT_LT(AppearanceGallery::similarity(red, blue), 0.5);
+  EXPECT_TRUE(AppearanceGallery::describe(frame, cv::Rect(300, 0, 10, 10))
+                  .empty());
+
+  AppearanceGallery gallery(2, 10, 0.85);
+  gallery.remember(1, red);
+  gallery.remember(2, blue);
+  gallery.remember(3, red);
+  EXPECT_EQ(gallery.size(), 2);
+  EXPECT_EQ(gallery.recall(red, {{3, cv::Rect()}}), -1);
+  EXPECT_EQ(gallery.recall(red, {}), 3);
+  EXPECT_EQ(gallery.size(), 1);
+  for (int i = 0; i < 11; i++) {
+    gallery.age();
+  }
+  EXPECT_EQ(gallery.size(), 0);
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking that class TrackingClass gives a lost obstacle its
+ * ID back when it reappears
+ */
+TEST(unit_test_track_reidentified, this_should_pass) {
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
+  cv::Mat frame(480, 640, CV_8UC3, cv::Scalar(40, 40, 40));
+  frame(cv::Rect(100, 100, 80, 80)).setTo(cv::Scalar(0, 0, 255));
+
+  std::vector<cv::Rect> detections = {cv::Rect(100, 100, 80, 80)};
+  obj_.updateTracks(detections, frame);
+  detections.clear();
+  for (int i = 0; i < 31; i++) {
+    obj_.updateTracks(detections, frame);
+  }
+  EXPECT_EQ(obj_.gallery.size(), 1);
+
+  detections = {cv::Rect(104, 100, 80, 80)};
+  auto events = obj_.updateTracks(detections, frame);
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].type, TrackEvent::kReacquired);
+  EXPECT_EQ(events[0].id, 1);
+  EXPECT_EQ(obj_.gallery.size(), 0);
+  // The re-identified obstacle did not use up a fresh ID
+  EXPECT_EQ(obj_.count, 1);
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for re-identification by class TrackingClass on a real image,
+ * described on the working frame with boxes at full resolution as in the app
+ */
+TEST(unit_test_track_reidentified_working_frame, this_should_pass) {
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
+  cv::Mat full = cv::imread("../../assets/faceImage.jpg");
+  ASSERT_FALSE(full.empty());
+  cv::Mat working;
+  cv::resize(full, working, cv::Size(full.cols / 2, full.rows / 2), 0, 0,
+             cv::INTER_AREA);
+  cv::Rect face(182, 64, 195, 195);
+
+  // Describing the scaled box on the working frame matches the full frame
+  EXPECT_GT(AppearanceGallery::similarity(
+                AppearanceGallery::describe(full, face),
+                AppearanceGallery::describe(working, face, full.size())),
+            0.95);
+
+  std::vector<cv::Rect> detections = {face};
+  obj_.updateTracks(detections, working, full.size());
+  // Long enough for the coasting face to be dropped
+  for (int i = 0; i < 31; i++) {
+    detections.clear();
+    obj_.updateTracks(detections, working, full.size());
+  }
+  EXPECT_TRUE(obj_.obstacleMapVector.empty());
+  EXPECT_EQ(obj_.gallery.size(), 1);
+
+  // The face reappears slightly moved, the background below it is new
+  detections = {cv::Rect(188, 64, 195, 195), cv::Rect(0, 200, 150, 150)};
+  auto events = obj_.updateTracks(detections, working, full.size());
+  ASSERT_EQ(events.size(), 2);
+  EXPECT_EQ(events[0].type, TrackEvent::kReacquired);
+  EXPECT_EQ(events[0].id, 1);
+  EXPECT_EQ(events[1].type, TrackEvent::kCreated);
+  EXPECT_EQ(events[1].id, 2);
+  EXPECT_EQ(obj_.count, 2);
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking that an ID held in the gallery for a missed obstacle
+ * is not handed to a different obstacle after an empty frame
+ */
+TEST(unit_test_track_id_not_reissued, this_should_pass) {
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
+  cv::Rect boxA(100, 100, 80, 80), boxB(400, 200, 80, 80);
+  cv::Mat frameA(480, 640, CV_8UC3, cv::Scalar(40, 40, 40));
+  frameA(boxA).setTo(cv::Scalar(0, 0, 255));
+  cv::Mat frameB(480, 640, CV_8UC3, cv::Scalar(40, 40, 40));
+  frameB(boxB).setTo(cv::Scalar(255, 0, 0));
+  cv::Mat frameAB = frameB.clone();
+  frameAB(boxA).setTo(cv::Scalar(0, 0, 255));
+
+  // A is found, then missed until it is dropped
+  std::vector<cv::Rect> detections = {boxA};
+  obj_.updateTracks(detections, frameA);
+  detections.clear();
+  for (int i = 0; i < 31; i++) {
+    obj_.updateTracks(detections, frameA);
+  }
+  EXPECT_EQ(obj_.gallery.size(), 1);
+
+  // A different obstacle B must not be given A's ID
+  detections = {boxB};
+  auto events = obj_.updateTracks(detections, frameB);
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].type, TrackEvent::kCreated);
+  EXPECT_EQ(events[0].id, 2);
+
+  // A comes back and gets its own ID again
+  detections = {boxA, boxB};
+  obj_.updateTracks(detections, frameAB);
+  ASSERT_EQ(obj_.obstacleMapVector.size(), 2);
+  EXPECT_EQ(obj_.obstacleMapVector[1], boxA);
+  EXPECT_EQ(obj_.obstacleMapVector[2], boxB);
+  EXPECT_EQ(obj_.count, 2);
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking that the policy based VgaTrackerCore keeps IDs,
+ * coasts obstacles in the centre and drops them at the border
+ */
+TEST(unit_test_tracker_core, this_should_pass) {
+  VgaTrackerCore core;
+  core.update({cv::Rect(100, 100, 80, 80), cv::Rect(5, 200, 60, 60)});
+  ASSERT_EQ(core.tracks().size(), 2);
+  EXPECT_EQ(core.count, 2);
+
+  core.update({cv::Rect(120, 110, 80, 80)});
+  ASSERT_EQ(core.tracks().size(), 1);
+  EXPECT_EQ(core.tracks()[0].id, 1);
+  EXPECT_EQ(core.tracks()[0].box, cv::Rect(120, 110, 80, 80));
+
+  core.update({});
+  ASSERT_EQ(core.tracks().size(), 1);
+  EXPECT_EQ(core.tracks()[0].missed, 1);
+
+  core.update({cv::Rect(400, 300, 80, 80)});
+  ASSERT_EQ(core.tracks().size(), 2);
+  EXPECT_EQ(core.tracks()[1].id, 3);
+
+  TrackerCore<VgaAssociationMetric, ConstantVelocityMotionModel,
+              PiecewiseDepthModel, VgaFrameGeometry, 2>
+      moving;
+  moving.update({cv::Rect(100, 200, 80, 80)});
+  moving.update({cv::Rect(140, 200, 80, 80)});
+  moving.update({cv::Rect(180, 200, 80, 80)});
+  moving.update({cv::Rect(250, 200, 80, 80)});
+  ASSERT_EQ(moving.tracks().size(), 1);
+  EXPECT_EQ(moving.tracks()[0].id, 1);
+  moving.update({});
+  moving.update({});
+  moving.update({});
+  EXPECT_EQ(moving.tracks().size(), 0);
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking that ConstantVelocityMotionModel converges to the
+ * displacement of an obstacle moving at constant speed
+ */
+TEST(unit_test_tracker_core_velocity, this_should_pass) {
+  TrackerCore<VgaAssociationMetric, ConstantVelocityMotionModel,
+              PiecewiseDepthModel, VgaFrameGeometry>
+      core;
+  for (int frame = 0; frame < 12; frame++) {
+    core.update({cv::Rect(20 + 40 * frame, 200, 60, 60)});
+  }
+  ASSERT_EQ(core.tracks().size(), 1);
+  EXPECT_EQ(core.tracks()[0].id, 1);
+  EXPECT_NEAR(core.tracks()[0].motion.vx, 40, 0.1);
+  EXPECT_NEAR(core.tracks()[0].motion.vy, 0, 1e-9);
+
+  // A coasting track keeps moving and a gap does not inflate the velocity
+  core.update({});
+  core.update({cv::Rect(20 + 40 * 13, 200, 60, 60)});
+  ASSERT_EQ(core.tracks().size(), 1);
+  EXPECT_EQ(core.tracks()[0].id, 1);
+  EXPECT_NEAR(core.tracks()[0].motion.vx, 40, 0.1);
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking that VgaTrackerCore and TrackingClass agree on the
+ * camera and car distance of an obstacle
+ */
+TEST(unit_test_tracker_core_depth, this_should_pass) {
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
+  VgaTrackerCore core;
+  std::vector<cv::Rect> detections = {cv::Rect(200, 150, 120, 180)};
+  obj_.updateTracks(detections);
+  core.update(detections);
+
+  auto expected = obj_.distFromCamera(640, 480)[1];
+  auto actual = core.cameraDistance(core.tracks()[0]);
+  EXPECT_DOUBLE_EQ(std::get<0>(actual), std::get<0>(expected));
+  EXPECT_DOUBLE_EQ(std::get<1>(actual), std::get<1>(expected));
+  EXPECT_DOUBLE_EQ(std::get<2>(actual), std::get<2>(expected));
+  EXPECT_DOUBLE_EQ(std::get<1>(core.carDistance(core.tracks()[0])),
+                   std::get<2>(expected));
+
+  // distFromCar() and carDistance() share one projection
+  auto camera = obj_.distFromCamera(640, 480);
+  auto expectedCar = obj_.distFromCar(camera)[1];
+  auto actualCar = core.carDistance(core.tracks()[0]);
+  EXPECT_DOUBLE_EQ(std::get<0>(actualCar), std::get<0>(expectedCar));
+  EXPECT_DOUBLE_EQ(std::get<1>(actualCar), std::get<1>(expectedCar));
+  EXPECT_DOUBLE_EQ(std::get<2>(actualCar), std::get<2>(expectedCar));
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking the car frame projection of VgaTrackerCore against
+ * a hand computed expectation
+ */
+TEST(unit_test_tracker_core_car_distance, this_should_pass) {
+  CameraMount mount;
+  mount.xOffset = 1;
+  mount.yOffset = 2;
+  mount.zOffset = 3;
+  VgaTrackerCore core(mount);
+  core.update({cv::Rect(200, 100, 120, 180)});
+
+  // Centre offset (-60, -50) pixels, depth 21 + 25 * 71 / 143 at height 180
+  double z = 21 + 25.0 * 71 / 143;
+  double x = z * 2 * std::tan(1.57 / 2) * -60 / 640;
+  double y = z * 2 * std::tan(0.7 / 2) * -50 / 480;
+  auto car = core.carDistance(core.tracks()[0]);
+  EXPECT_NEAR(std::get<0>(car), x + 1, 1e-9);
+  EXPECT_NEAR(std::get<1>(car), z + 2, 1e-9);
+  EXPECT_NEAR(std::get<2>(car), -y + 3, 1e-9);
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking that class BatchProcessor decodes every still of a
+ * directory and finds the same faces as detectFaces() one image at a time
+ */
+TEST(unit_test_batch_directory, this_should_pass) {
+  DetectionClass obj_(
+      "../../models/res10_300x300_ssd_iter_140000_fp16.caffemodel",
+      "../../models/deploy.prototxt");
+  BatchProcessor batch(obj_, 2, 3, 2);
+  batch.rowGroupImages = 2;
+
+  // Pinning inference in its hook must not narrow the pool's affinity
+  cpu_set_t before;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(before), &before), 0);
+  std::atomic<int> decodeStarts(0), narrowedDecoders(0);
+  batch.onDecodeStart = [&]() {
+    cpu_set_t mask;
+    sched_getaffinity(0, sizeof(mask), &mask);
+    decodeStarts++;
+    narrowedDecoders += CPU_COUNT(&mask) != CPU_COUNT(&before) ? 1 : 0;
+  };
+  batch.onInferenceStart = [&]() {
+    ThreadPlacement placement;
+    placement.parseOption("--inference-cpus", "0");
+    placement.pinCurrentThread(ThreadRole::kInference);
+  };
+  std::thread caller([&]() {
+    EXPECT_TRUE(batch.run("../../assets", "batch_test.htbd"));
+  });
+  caller.join();
+  EXPECT_EQ(decodeStarts, 2);
+  EXPECT_EQ(narrowedDecoders, 0);
+  EXPECT_EQ(batch.imagesDecoded, 4);
+  EXPECT_EQ(batch.imagesFailed, 0);
+
+  std::vector<BatchResult> results;
+  ASSERT_TRUE(BatchProcessor::readOutput("batch_test.htbd", results));
+  ASSERT_EQ(results.size(), 4);
+  long faces = 0;
+  for (const auto& result : results) {
+    cv::Mat image = cv::imread(result.path);
+    EXPECT_EQ(result.size, image.size());
+    EXPECT_EQ(BatchProcessor::decodeFile(result.path).size(), image.size());
+    EXPECT_EQ(result.faces.size(), obj_.detectFaces(image).size());
+    faces += result.faces.size();
+  }
+  EXPECT_EQ(faces, batch.facesWritten);
+  EXPECT_FALSE(BatchProcessor::isImagePath("../../assets/video.mp4"));
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking that a tracker restored from a checkpoint keeps its
+ * obstacle IDs and that stale or corrupted checkpoints are rejected
+ */
+TEST(unit_test_checkpoint_restore, this_should_pass) {
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
+  std::vector<cv::Rect> detections = {cv::Rect(100, 100, 80, 80),
+                                      cv::Rect(300, 200, 60, 60)};
+  obj_.updateTracks(detections);
+  TrackerState state;
+  obj_.snapshot(state);
+  ASSERT_TRUE(TrackerCheckpoint::save("checkpoint_test.bin", state,
+                                      TrackerCheckpoint::nowMs()));
+
+  TrackingClass restarted(0, 0, 0, 1.57, 0.7);
+  TrackerState loaded;
+  double age = -1;
+  ASSERT_TRUE(
+      TrackerCheckpoint::load("checkpoint_test.bin", loaded, 5, &age));
+  EXPECT_GE(age, 0);
+  restarted.restore(loaded);
+  EXPECT_EQ(restarted.count, obj_.count);
+  EXPECT_EQ(restarted.obstacleMapVector, obj_.obstacleMapVector);
+
+  // A counter behind the restored IDs is raised, IDs are not handed out twice
+  TrackerState behind = loaded;
+  behind.count = 1;
+  TrackingClass clamped(0, 0, 0, 1.57, 0.7);
+  clamped.restore(behind);
+  EXPECT_EQ(clamped.count, 2);
+  detections = {cv::Rect(100, 100, 80, 80), cv::Rect(300, 200, 60, 60),
+                cv::Rect(450, 300, 60, 60)};
+  auto events = clamped.updateTracks(detections);
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].type, TrackEvent::kCreated);
+  EXPECT_EQ(events[0].id, 3);
+
+  ASSERT_TRUE(TrackerCheckpoint::save("checkpoint_test.bin", state,
+                                      TrackerCheckpoint::nowMs() - 60000));
+  EXPECT_FALSE(TrackerCheckpoint::load("checkpoint_test.bin", loaded, 5));
+
+  ASSERT_TRUE(TrackerCheckpoint::save("checkpoint_test.bin", state,
+                                      TrackerCheckpoint::nowMs()));
+  std::fstream file("checkpoint_test.bin",
+                    std::ios::in | std::ios::out | std::ios::binary);
+  file.seekp(30);
+  file.put('\x7f');
+  file.close();
+  EXPECT_FALSE(TrackerCheckpoint::load("checkpoint_test.bin", loaded, 5));
+  EXPECT_FALSE(TrackerCheckpoint::load("missing_checkpoint.bin", loaded, 5));
+}
+
+/**
+ * @brief Construct a new TEST object.
+ * unit test for checking that class TrackerCheckpoint writes snapshots in the
+ * background and rate limits them
+ */
+TEST(unit_test_checkpoint_writer, this_should_pass) {
+  TrackingClass obj_(0, 0, 0, 1.57, 0.7);
+  std::vector<cv::Rect> detections = {cv::Rect(100, 100, 80, 80)};
+  obj_.updateTracks(detections);
+  {
+    TrackerCheckpoint checkpoint("checkpoint_writer.bin", 60);
+    EXPECT_TRUE(checkpoint.publish(obj_));
+    EXPECT_FALSE(checkpoint.publish(obj_));
+  }
+  TrackerState loaded;
+  ASSERT_TRUE(TrackerCheckpoint::load("checkpoint_writer.bin", loaded, 5));
+  EXPECT_EQ(loaded.tracks, obj_.obstacleMapVector);
+  EXPECT_EQ(loaded.count, obj_.count);
+
+  TrackerCheckpoint disabled("");
+  EXPECT_FALSE(disabled.publish(obj_));
+}